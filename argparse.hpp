@@ -34,9 +34,10 @@ namespace argparse {
   template<class T>
   static const auto option(const char* name) {
     const std::string target = "--" + std::string(name);
+    // note: result is named after the option, not the matched item
     return pop_if([=](const char* item) {
         return item == target;
-      }) >> argument<T>;
+      }) >> [name](const char*) { return argument<T>(name); };
   };
 
 
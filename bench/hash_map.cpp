@@ -0,0 +1,90 @@
+// symbol table lookups: std::map vs hash_map, using the symbols of the given
+// source files, looked up in source order
+#include "../symbol.hpp"
+#include "../hash_map.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <vector>
+
+static std::vector<symbol> tokens(std::istream& in) {
+  std::vector<symbol> res;
+  std::string token;
+
+  const auto flush = [&] {
+    if(!token.empty()) res.emplace_back(token);
+    token.clear();
+  };
+
+  char c;
+  while(in.get(c)) {
+    switch(c) {
+    case '(': case ')': case '"': case '\'':
+    case ' ': case '\t': case '\n':
+      flush();
+      break;
+    case ';':
+      flush();
+      while(in.get(c) && c != '\n') { }
+      break;
+    default:
+      token += c;
+    }
+  }
+
+  flush();
+  return res;
+}
+
+
+// average lookup time in nanoseconds
+template<class Map>
+static double bench(const std::vector<symbol>& keys, std::size_t rounds) {
+  Map map;
+  for(std::size_t i = 0, n = keys.size(); i < n; ++i) {
+    map.emplace(keys[i], i);
+  }
+
+  std::size_t sum = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for(std::size_t r = 0; r < rounds; ++r) {
+    for(symbol key: keys) {
+      sum += map.find(key)->second;
+    }
+  }
+  const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+
+  // note: keep lookups alive
+  if(sum == std::size_t(-1)) std::clog << sum;
+  return 1e9 * duration.count() / double(rounds * keys.size());
+}
+
+
+int main(int argc, char** argv) {
+  std::cout << "file\tsymbols\tlookups\tstd::map (ns)\thash_map (ns)" << std::endl;
+
+  for(int i = 1; i < argc; ++i) {
+    std::ifstream in(argv[i]);
+    if(!in) {
+      std::cerr << "cannot open file " << argv[i] << std::endl;
+      return 1;
+    }
+
+    const std::vector<symbol> keys = tokens(in);
+    if(keys.empty()) continue;
+
+    std::map<symbol, bool> unique;
+    for(symbol key: keys) unique.emplace(key, true);
+
+    const std::size_t rounds = 1 + (1ul << 22) / keys.size();
+    const double tree = bench<std::map<symbol, std::size_t>>(keys, rounds);
+    const double hash = bench<hash_map<symbol, std::size_t>>(keys, rounds);
+
+    std::cout << argv[i] << "\t" << unique.size() << "\t" << keys.size()
+              << "\t" << tree << "\t" << hash << std::endl;
+  }
+
+  return 0;
+}
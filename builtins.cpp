@@ -23,6 +23,10 @@ namespace type {
       .def("*", integer >>= integer >>= integer)
       .def("-", integer >>= integer >>= integer)
       .def("=", integer >>= integer >>= boolean)
+      .def("<", integer >>= integer >>= boolean)
+      .def("<=", integer >>= integer >>= boolean)
+      .def(">", integer >>= integer >>= boolean)
+      .def(">=", integer >>= integer >>= boolean)
       ;
 
     // function
@@ -159,6 +163,22 @@ namespace eval {
         return lhs == rhs;
       }))
 
+      .def("<", closure(+[](const integer& lhs, const integer& rhs) -> boolean {
+        return lhs < rhs;
+      }))
+
+      .def("<=", closure(+[](const integer& lhs, const integer& rhs) -> boolean {
+        return lhs <= rhs;
+      }))
+
+      .def(">", closure(+[](const integer& lhs, const integer& rhs) -> boolean {
+        return lhs > rhs;
+      }))
+
+      .def(">=", closure(+[](const integer& lhs, const integer& rhs) -> boolean {
+        return lhs >= rhs;
+      }))
+
       ;
 
     value ctor = closure(+[](const unit&) { return unit(); });
@@ -217,13 +237,13 @@ namespace eval {
 
 
 namespace vm {
-  state builtins() {
-    state self(1000);
+  ref<state> builtins() {
+    auto self = make_ref<state>(1000);
 
     value ctor = builtin(1, [](const value* args) -> value { return unit(); });
     value ctor2 = builtin(2, [](const value* args) -> value { return unit(); });    
     
-    self
+    (*self)
       .def("+", builtin([](const integer& lhs, const integer& rhs) -> integer {
         return lhs + rhs;
       }))
@@ -239,19 +259,66 @@ namespace vm {
       .def("=", builtin([](const integer& lhs, const integer& rhs) -> boolean {
         return lhs == rhs;
       }))
+
+      .def("<", builtin([](const integer& lhs, const integer& rhs) -> boolean {
+        return lhs < rhs;
+      }))
+
+      .def("<=", builtin([](const integer& lhs, const integer& rhs) -> boolean {
+        return lhs <= rhs;
+      }))
+
+      .def(">", builtin([](const integer& lhs, const integer& rhs) -> boolean {
+        return lhs > rhs;
+      }))
+
+      .def(">=", builtin([](const integer& lhs, const integer& rhs) -> boolean {
+        return lhs >= rhs;
+      }))
       
-      // .def("cons", builtin(2, [](const value* args) -> value {
-      //   return args[0] >>= args[1].cast<list<value>>();
-      // }))
+      .def(kw::cons, builtin(2, [](const value* args) -> value {
+        return gc::make_ref<cons>(args[0], args[1]);
+      }))
+
+      .def(kw::nil, nil())
+
+      // ctors (will never be called)
+      .def("->", ctor2)
+      .def("type", ctor)
+      .def("ctor", ctor)
+      .def("list", ctor)
+
+      .def("string", unit())
+      .def("real", unit())
+      .def("integer", unit())
+      .def("boolean", unit())
+      .def("unit", unit())
+
+      // note: computations are performed eagerly
+      .def("ref", builtin(1, [](const value* args) -> value {
+        return make_cell(args[0]);
+      }))
 
-      // .def("nil", list<value>())
-      // .def("list", ctor)
+      .def("get", builtin(1, [](const value* args) -> value {
+        return args[0].cast<gc::ref<record>>()->values()[0];
+      }))
+
+      .def("set", builtin(2, [](const value* args) -> value {
+        update(args[0].cast<gc::ref<record>>(), args[1]);
+        return unit();
+      }))
       
+      .def("pure", builtin(1, [](const value* args) -> value {
+        return args[0];
+      }))
+
+      // strings
+      .def("print", builtin(1, [](const value* args) -> value {
+        std::cout << *args[0].cast<gc::ref<string>>();
+        return unit();
+      }))
       ;
     
-        
-        
-    
     return self;
   }
 
@@ -265,7 +332,7 @@ namespace package {
     
     import<eval::state::ref>(name, eval::builtins);
 
-    import<vm::state>(name, vm::builtins);
+    import<ref<vm::state>>(name, vm::builtins);
   }
 }
 
@@ -0,0 +1,361 @@
+#include "bytecode.hpp"
+
+#include "ir.hpp"
+#include "tool.hpp"
+#include "package.hpp"
+
+#include <iostream>
+
+namespace vm {
+
+  word instr::make(opcode op, std::size_t arg) {
+    if(arg > operand_max) {
+      throw std::runtime_error("bytecode operand overflow");
+    }
+
+    return word(op) | word(arg << opcode_bits);
+  }
+
+
+  std::size_t cache::miss(const shape* key) const {
+    const std::size_t res = key->find(attr);
+    if(res == key->size()) {
+      throw std::runtime_error("record attribute error");
+    }
+    
+    entries[next++ % size] = {key, res};
+    return res;
+  }
+
+  
+  // lowering state for a single function
+  struct emitter {
+    function* self;
+    state* globals;
+
+    std::size_t here() const { return self->code.size(); }
+
+    std::size_t emit(opcode op, std::size_t arg = 0) {
+      const std::size_t res = here();
+      self->code.emplace_back(instr::make(op, arg));
+      return res;
+    }
+
+    // set jump target of a previously emitted instruction
+    void patch(std::size_t at, std::size_t target) {
+      self->code[at] = instr::make(instr::op(self->code[at]), target);
+    }
+
+    template<class T, class U>
+    static std::size_t add(std::vector<T>& table, U&& value) {
+      table.emplace_back(std::forward<U>(value));
+      return table.size() - 1;
+    }
+
+    std::size_t add(symbol name) {
+      // note: symbols are shared between all instructions
+      for(std::size_t i = 0, n = self->symbols.size(); i < n; ++i) {
+        if(self->symbols[i] == name) return i;
+      }
+
+      return add(self->symbols, name);
+    }
+
+
+    template<class T>
+    void operator()(const T& ) {
+      throw std::runtime_error("bytecode unimplemented for: "
+                               + tool::type_name(typeid(T)));
+    }
+
+    template<class T>
+    void operator()(const ir::lit<T>& lit) {
+      emit(opcode::constant, add(self->constants, value(lit.value)));
+    }
+
+    void operator()(const ir::lit<unit>& ) {
+      emit(opcode::unit);
+    }
+
+    void operator()(const ir::lit<string>& lit) {
+      emit(opcode::string, add(self->strings, lit.value));
+    }
+
+    void operator()(const ir::local& local) {
+      emit(opcode::local, local.index);
+    }
+
+    void operator()(const ir::capture& capture) {
+      emit(opcode::capture, capture.index);
+    }
+
+    void operator()(const ir::global& global) {
+      emit(opcode::global, globals->slot(global.name));
+    }
+
+    void operator()(const ir::call& call) {
+      emit(call.tail ? opcode::tailcall : opcode::call, call.argc);
+    }
+
+    void operator()(const ir::direct& direct) {
+      const std::size_t slot = globals->slot(direct.name);
+      const std::size_t at = emit(direct.tail ? opcode::tail_direct : opcode::direct,
+                                  direct.argc);
+      self->directs.emplace_back(at, slot);
+    }
+
+    void operator()(const ir::prim& prim) {
+      static const opcode ops[] = {
+        opcode::add, opcode::sub, opcode::mul, opcode::eq,
+        opcode::lt, opcode::le, opcode::gt, opcode::ge
+      };
+
+      static const opcode unguarded[] = {
+        opcode::int_add, opcode::int_sub, opcode::int_mul, opcode::int_eq,
+        opcode::int_lt, opcode::int_le, opcode::int_gt, opcode::int_ge
+      };
+
+      if(!prim.guarded) {
+        emit(unguarded[prim.op]);
+        return;
+      }
+
+      // note: callee is checked against the builtin at runtime, so that
+      // redefinitions fall back to regular calls
+      static const symbol package = "builtins";
+      if(const ref<state>* builtins = package::find<ref<state>>(package)) {
+        const state& lib = **builtins;
+        
+        auto it = lib.slots.find(prim.name);
+        if(it != lib.slots.end() && lib.defined[it->second] &&
+           lib.globals[it->second].is<builtin>()) {
+          emit(ops[prim.op], add(self->constants, lib.globals[it->second]));
+          return;
+        }
+      }
+
+      emit(opcode::call, 2);
+    }
+
+    void operator()(const ir::block& block) {
+      for(const ir::expr& e: block.items) {
+        e.visit(*this);
+      }
+    }
+
+    void operator()(const ir::exit& exit) {
+      emit(opcode::exit, exit.locals);
+    }
+
+    void operator()(const ir::drop& drop) {
+      emit(opcode::drop, drop.count);
+    }
+
+    void operator()(const ir::sel& sel) {
+      const std::size_t index = add(self->selects, sel.attr);
+      
+      if(!sel.row.empty()) {
+        // closed record type: offset is known, seed cache with expected shape
+        const shape* key = shape::intern(sel.row);
+        self->selects[index].entries[0] = {key, key->find(sel.attr)};
+        self->selects[index].next = 1;
+      }
+      
+      // note: list cells may appear wherever a {head; tail} record does
+      static const symbol head = "head", tail = "tail";
+      emit(sel.attr == head ? opcode::head :
+           sel.attr == tail ? opcode::tail : opcode::sel, index);
+    }
+
+    void operator()(const ir::record& record) {
+      const shape* s = shape::intern(record.attrs);
+      
+      std::vector<std::size_t> offsets;
+      for(symbol attr: record.attrs) {
+        offsets.emplace_back(s->find(attr));
+      }
+      
+      emit(opcode::record, add(self->records, layout{s, std::move(offsets)}));
+    }
+
+    void operator()(const ir::inj& inj) {
+      emit(opcode::inj, sum::ordinal(inj.tag));
+    }
+
+    void operator()(const ir::import& import) {
+      emit(opcode::import, add(import.package));
+    }
+
+    void operator()(const ir::def& def) {
+      emit(opcode::def, globals->slot(def.name));
+    }
+
+    void operator()(const ref<ir::use>& use) {
+      use->env.visit(*this);
+      emit(opcode::use);
+    }
+
+    void operator()(const ref<ir::branch>& branch) {
+      // precondition: test is pushed
+      const std::size_t test = emit(opcode::jump_false);
+      branch->then.visit(*this);
+
+      const std::size_t skip = emit(opcode::jump);
+      patch(test, here());
+      branch->alt.visit(*this);
+
+      patch(skip, here());
+    }
+
+    void operator()(const ref<ir::match>& match) {
+      // precondition: matched value is pushed and is a sum value
+      const std::size_t index = add(self->matches, dispatch());
+      emit(opcode::match, index);
+
+      // intern known sum tags first so that they get consecutive ordinals
+      for(symbol tag: match->row) {
+        sum::ordinal(tag);
+      }
+      
+      std::vector<std::size_t> skips;
+      std::map<std::size_t, std::size_t> cases;
+
+      // note: referencing table by index as cases may emit more tables
+      for(const auto& it: match->cases) {
+        cases.emplace(sum::ordinal(it.first), here());
+        it.second.visit(*this);
+        skips.emplace_back(emit(opcode::jump));
+      }
+
+      const std::size_t fallback = here();
+      match->fallback.visit(*this);
+
+      dispatch& table = self->matches[index];
+      table.fallback = fallback;
+
+      if(!cases.empty()) {
+        const std::size_t first = cases.begin()->first;
+        const std::size_t last = cases.rbegin()->first;
+
+        // jump table unless tags are too sparse (open sums)
+        if(last - first < 2 * cases.size() + 4) {
+          table.base = first;
+          table.table.resize(last - first + 1, table.fallback);
+          for(const auto& it: cases) {
+            table.table[it.first - first] = it.second;
+          }
+        } else {
+          table.sparse.insert(cases.begin(), cases.end());
+        }
+      }
+
+      for(std::size_t skip: skips) {
+        patch(skip, here());
+      }
+
+      // pop matched data under result
+      emit(opcode::exit, 1);
+    }
+
+
+    void operator()(const ref<ir::closure>& closure) {
+      function sub;
+      sub.owner = globals;
+      sub.argc = closure->argc;
+      sub.captures = closure->captures.size();
+      sub.source = closure;
+
+      emitter{&sub, globals}(closure->body);
+      emitter{&sub, globals}.emit(opcode::ret);
+
+      const ref<const function> code = make_ref<const function>(std::move(sub));
+      globals->link(code);
+
+      // note: toplevel code runs once anyway
+      if(closure->lifted && self->source) {
+        emit(opcode::lifted, add(self->lifts, function::lift{code, unit()}));
+        return;
+      }
+      
+      // note: closure is pushed *before* captures so that it can capture
+      // itself (recursive definitions)
+      emit(opcode::closure, add(self->functions, code));
+      for(const ir::expr& c: closure->captures) {
+        c.visit(*this);
+      }
+      emit(opcode::close, closure->captures.size());
+    }
+
+  };
+
+
+  ref<const function> compile(state* s, const ir::expr& self) {
+    function res;
+    res.owner = s;
+    emitter e{&res, s};
+    self.visit(e);
+    e.emit(opcode::halt);
+
+    const ref<const function> code = make_ref<const function>(std::move(res));
+    s->link(code);
+    return code;
+  }
+
+
+  static const char* name(opcode op) {
+    static const char* table[] = {
+#define SLIP_OPCODE_NAME(name) #name,
+      SLIP_OPCODES(SLIP_OPCODE_NAME)
+#undef SLIP_OPCODE_NAME
+    };
+
+    return table[std::size_t(op)];
+  }
+
+
+  static void disassemble(std::ostream& out, const function& self,
+                          std::size_t level) {
+    const std::string indent(2 * level, ' ');
+
+    for(std::size_t i = 0, n = self.code.size(); i < n; ++i) {
+      const word w = self.code[i];
+      const opcode op = instr::op(w);
+      const std::size_t arg = instr::arg(w);
+
+      out << indent << i << ":\t" << name(op) << "\t" << arg;
+      switch(op) {
+      case opcode::constant:
+      case opcode::add:
+      case opcode::sub:
+      case opcode::mul:
+      case opcode::eq:
+      case opcode::lt:
+      case opcode::le:
+      case opcode::gt:
+      case opcode::ge: out << "\t; " << self.constants[arg]; break;
+      case opcode::string: out << "\t; " << tool::quote(self.strings[arg]); break;
+      case opcode::inj: out << "\t; " << sum::name(arg); break;
+      case opcode::head:
+      case opcode::tail:
+      case opcode::sel: out << "\t; " << self.selects[arg].attr; break;
+      case opcode::import: out << "\t; " << self.symbols[arg]; break;
+      default: break;
+      }
+      out << std::endl;
+
+      if(op == opcode::closure) {
+        disassemble(out, *self.functions[arg], level + 1);
+      }
+
+      if(op == opcode::lifted) {
+        disassemble(out, *self.lifts[arg].code, level + 1);
+      }
+    }
+  }
+
+  std::ostream& operator<<(std::ostream& out, const function& self) {
+    disassemble(out, self, 0);
+    return out;
+  }
+
+}
@@ -0,0 +1,186 @@
+#ifndef SLIP_BYTECODE_HPP
+#define SLIP_BYTECODE_HPP
+
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "vm.hpp"
+
+namespace vm {
+
+  // instruction set: opcode name, operand meaning
+#define SLIP_OPCODES(X)                                 \
+  X(unit)         /* push unit */                       \
+  X(constant)     /* push constants[arg] */             \
+  X(string)       /* push fresh string from strings[arg] */ \
+  X(local)        /* push local variable arg */         \
+  X(capture)      /* push captured variable arg */      \
+  X(global)       /* push global slot arg */            \
+  X(call)         /* call function with arg arguments */ \
+  X(tailcall)     /* call in tail position, reusing current frame */ \
+  X(direct)       /* call closure taking exactly arg arguments, unchecked */ \
+  X(tail_direct)  /* direct call in tail position */    \
+  X(ret)          /* return from closure call */        \
+  X(apply)        /* apply result to remaining arguments */ \
+  X(add)          /* integer ops on two arguments when callee is constants[arg], */ \
+  X(sub)          /* call otherwise */                  \
+  X(mul)                                                \
+  X(eq)                                                 \
+  X(lt)                                                 \
+  X(le)                                                 \
+  X(gt)                                                 \
+  X(ge)                                                 \
+  X(int_add)      /* integer ops on two arguments, unchecked */ \
+  X(int_sub)                                            \
+  X(int_mul)                                            \
+  X(int_eq)                                             \
+  X(int_lt)                                             \
+  X(int_le)                                             \
+  X(int_gt)                                             \
+  X(int_ge)                                             \
+  X(closure)      /* push closure for functions[arg] */ \
+  X(close)        /* pop arg captures into closure */   \
+  X(lifted)       /* push lifts[arg], created on first use */ \
+  X(drop)         /* pop arg values */                  \
+  X(exit)         /* pop result, pop arg values, push result */ \
+  X(jump)         /* jump to arg */                     \
+  X(jump_false)   /* pop boolean, jump to arg if false */ \
+  X(match)        /* replace sum with data, dispatch on tag using matches[arg] */ \
+  X(inj)          /* pop data, push sum with tag ordinal arg */ \
+  X(sel)          /* select attribute through selects[arg] cache */ \
+  X(head)         /* list head, or select through selects[arg] */ \
+  X(tail)         /* list tail, or select through selects[arg] */ \
+  X(record)       /* build record using records[arg] layout */ \
+  X(import)       /* import package symbols[arg] */     \
+  X(use)          /* pop record and define its attributes */ \
+  X(def)          /* pop value and define global slot arg */ \
+  X(halt)         /* end of toplevel code */
+
+
+  enum class opcode : std::uint8_t {
+#define SLIP_OPCODE_ENUM(name) name,
+    SLIP_OPCODES(SLIP_OPCODE_ENUM)
+#undef SLIP_OPCODE_ENUM
+  };
+
+
+  // instructions are single words: opcode in the low byte, operand in the
+  // remaining high bits
+  struct instr {
+    static constexpr std::size_t opcode_bits = 8;
+    static constexpr word operand_max = word(-1) >> opcode_bits;
+
+    static word make(opcode op, std::size_t arg = 0);
+
+    static opcode op(word self) { return opcode(self & 0xff); }
+    static std::size_t arg(word self) { return self >> opcode_bits; }
+  };
+
+
+  // sum dispatch table: code offsets indexed by tag ordinal (relative to
+  // base), or hashed when case ordinals are too sparse
+  struct dispatch {
+    std::size_t base = 0;
+    std::vector<std::size_t> table;
+    std::unordered_map<std::size_t, std::size_t> sparse;
+    std::size_t fallback;
+
+    std::size_t find(std::size_t tag) const {
+      const std::size_t index = tag - base;
+      if(index < table.size()) return table[index];
+
+      auto it = sparse.find(tag);
+      return it == sparse.end() ? fallback : it->second;
+    }
+  };
+
+
+  // record construction: shape, and offset for each pushed value
+  struct layout {
+    const shape* self;
+    std::vector<std::size_t> offsets;
+  };
+
+
+  // polymorphic inline cache for attribute selection
+  struct cache {
+    static constexpr std::size_t size = 4;
+
+    const symbol attr;
+    
+    struct entry {
+      const shape* key = nullptr;
+      std::size_t offset;
+    };
+
+    // note: filled at runtime, round-robin when megamorphic
+    mutable entry entries[size];
+    mutable std::size_t next = 0;
+
+    cache(symbol attr): attr(attr) { }
+    
+    std::size_t offset(const shape* key) const {
+      for(const entry& e: entries) {
+        if(e.key == key) return e.offset;
+      }
+
+      return miss(key);
+    }
+
+  private:
+    std::size_t miss(const shape* key) const;
+  };
+  
+
+  // compiled function: flat code + operand tables
+  struct function {
+    std::size_t argc = 0;
+    std::size_t captures = 0;
+
+    // state holding globals
+    state* owner = nullptr;
+
+    // closure code was compiled from, for inlining
+    ref<const ir::closure> source;
+
+    // note: direct calls are patched back to calls when their callee is
+    // redefined (see state::def)
+    mutable std::vector<word> code;
+
+    // direct call sites: instruction offset and callee global slot
+    std::vector<std::pair<std::size_t, std::size_t>> directs;
+
+    std::vector<value> constants;
+    std::vector<string> strings;
+    std::vector<symbol> symbols;
+    std::vector<layout> records;
+    std::vector<cache> selects;
+    std::vector<dispatch> matches;
+    std::vector<ref<const function>> functions;
+
+    // lifted closures: created on first use, then shared by all closures of
+    // this code. note: they are roots as long as this code is alive (see
+    // state::link)
+    struct lift {
+      ref<const function> code;
+      mutable value instance;
+    };
+    
+    std::vector<lift> lifts;
+  };
+
+
+  // lower intermediate representation to bytecode, resolving globals to
+  // state slots
+  ref<const function> compile(state* s, const ir::expr& self);
+
+  // disassemble
+  std::ostream& operator<<(std::ostream& out, const function& self);
+
+}
+
+#endif
@@ -6,6 +6,7 @@
 
 #include "ref.hpp"
 #include "symbol.hpp"
+#include "hash_map.hpp"
 #include "list.hpp"
 
 #include "tool.hpp"
@@ -13,7 +14,7 @@
 // environments
 template<class T>
 struct environment {
-  using locals_type = std::map<symbol, T>;
+  using locals_type = hash_map<symbol, T>;
   locals_type locals;
   ref<environment> parent;
 
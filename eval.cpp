@@ -482,38 +482,65 @@ struct ostream_visitor {
   }
 
 
-  static void mark(const value& self, bool debug) {
-    self.match([&](const value& ) { },
-               [&](const ref<record>& self) {
-                 for(const auto& it : *self) {
-                   mark(it.second, debug);
-                 }
-               },
-               [&](const ref<sum>& self) {
-                 mark(*self, debug);
-               },
-               [&](const lambda& self) {
-                 mark(self.env, debug);
-               });
-  }
-  
-
+  // note: explicit mark stacks so that deep environments or data don't
+  // exhaust the C stack
   void mark(state::ref e, bool debug) {
-    if(debug) std::clog << "marking:\t" << e.get() << std::endl;
+    std::vector<state::ref> states;
+    std::vector<const value*> values;
+
+    const auto push = [&](state::ref self) {
+      if(self.mark()) states.emplace_back(self);
+    };
+
+    push(e);
     
-    if(e.marked()) return;
-    e.mark();
+    while(!states.empty() || !values.empty()) {
+      if(!values.empty()) {
+        const value* self = values.back();
+        values.pop_back();
+        
+        self->match([&](const value& ) { },
+                    [&](const ref<record>& self) {
+                      for(const auto& it : *self) {
+                        values.emplace_back(&it.second);
+                      }
+                    },
+                    [&](const ref<sum>& self) {
+                      values.emplace_back(self.get());
+                    },
+                    [&](const lambda& self) {
+                      push(self.env);
+                    });
+        continue;
+      }
+
+      const state::ref self = states.back();
+      states.pop_back();
+      
+      if(debug) std::clog << "marking:\t" << self.get() << std::endl;
     
-    for(auto& it : e->locals) {
-      mark(it.second, debug);
-    }
+      for(const auto& it : self->locals) {
+        values.emplace_back(&it.second);
+      }
 
-    if(e->parent) {
-      mark(e->parent, debug);
+      if(self->parent) {
+        push(self->parent);
+      }
     }
   }
 
   
+  stats::census census() {
+    stats::census res;
+    gc::current().census([&](const std::type_info& type, const gc::count& c) {
+        stats::count& total = res[type == typeid(state) ? "state" : tool::type_name(type)];
+        total.objects += c.objects;
+        total.bytes += c.bytes;
+      });
+    return res;
+  }
+
+  
   value* state::find(symbol name)  {
     auto it = locals.find(name);
     if(it != locals.end()) return &it->second;
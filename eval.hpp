@@ -10,6 +10,7 @@
 #include "ast.hpp"
 
 #include "gc.hpp"
+#include "stats.hpp"
 
 namespace eval {
 
@@ -22,7 +23,7 @@ namespace eval {
     using ref = gc::ref<state>;
     
     ref parent;
-    std::map<symbol, value> locals;
+    hash_map<symbol, value> locals;
 
     value* find(symbol name);
     friend ref scope(ref self);
@@ -32,7 +33,7 @@ namespace eval {
     state& def(symbol name, const value&);
   };
   
-  using record = std::map<symbol, value>;
+  using record = hash_map<symbol, value>;
   
   struct sum;
   
@@ -103,6 +104,10 @@ namespace eval {
 
   void mark(state::ref e, bool debug=false);
 
+  // objects allocated in the calling thread heap, by type. note: evaluation
+  // never collects
+  stats::census census();
+
 }
 
 
@@ -2,48 +2,357 @@
 #define SLIP_GC_HPP
 
 // #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <typeinfo>
 #include <utility>
+#include <new>
+#include <vector>
+
+#include <sys/mman.h>
 
 template<class Tag>
 class gc {
 
   struct block {
-    virtual ~block() { }
+    // young objects: forwarding address once promoted
+    block* forward = nullptr;
 
-    union {
-      block* ptr;
-      std::size_t bits;
-    } next;
-      
-    block() {
-      next.ptr = first;
-      first = this;
-    }
-      
-    // gc mark in lower order bits
-    void set_mark(bool value) {
-      if(value) next.bits |= 1ul;
-      else next.bits &= ~1ul;
-    }
-      
-    bool get_mark() const {
-      return next.bits & 1ul;
-    }
+    // allocation size
+    std::uint32_t size = 0;
 
+    enum : std::uint32_t {
+      young = 1,
+      remembered = 2,
+      large = 4,
+      marked = 8                // large objects only
+    };
+
+    std::uint32_t flags = 0;
   };
-    
+
   template<class T>
   struct managed : block {
     T value;
 
     template<class ... Args>
     managed(Args&& ... args): value(std::forward<Args>(args)...) { }
+
+    // move object and trailing storage to old space, leaving the header in
+    // place for forwarding
+    managed* relocate(void* ptr) {
+      managed* res = new (ptr) managed(std::move(value));
+      std::memcpy(static_cast<void*>(res + 1), this + 1,
+                  this->size - sizeof(managed));
+      res->size = this->size;
+      value.~T();
+      return res;
+    }
+
+    static void destroy(block* self) {
+      static_cast<managed*>(self)->~managed();
+    }
   };
 
-  static block* first;
+  using destroy_type = void (*)(block*);
+
+  template<class T>
+  static constexpr destroy_type destructor() {
+    return std::is_trivially_destructible<T>::value ? nullptr : managed<T>::destroy;
+  }
+
+  // size classes
+  static constexpr std::size_t granularity = 16;
+  static constexpr std::size_t min_class = 32;
+  static constexpr std::size_t max_class = 256;
+  static constexpr std::size_t classes = max_class / granularity;
+
+  // slab page: objects of a single type and size class, with inline used/mark
+  // bitmaps. pages are aligned on their size so that objects find their page
+  // by masking
+  struct alignas(granularity) page {
+    static constexpr std::size_t size = 1ul << 16;
+    static constexpr std::size_t words = size / min_class / 64;
+
+    std::size_t object;
+    std::size_t capacity;
+    std::uint64_t inverse;
+    destroy_type destroy;
+
+    // first word possibly holding free slots
+    std::size_t cursor = 0;
+
+    // index in pending sweep, if any
+    std::size_t ticket = -1;
+
+    std::uint64_t used[words] = {};
+    std::uint64_t marks[words] = {};
+
+    page(std::size_t object, destroy_type destroy):
+      object(object),
+      capacity((size - sizeof(page)) / object),
+      // note: exact division by multiplication for offsets below page size
+      inverse((1ul << 32) / object + 1),
+      destroy(destroy) { }
+
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+
+    static page* of(const block* self) {
+      return reinterpret_cast<page*>(std::uintptr_t(self) & ~(size - 1));
+    }
+
+    std::size_t index(const block* self) const {
+      const std::uint64_t offset = reinterpret_cast<const char*>(self)
+        - reinterpret_cast<const char*>(this + 1);
+      return (offset * inverse) >> 32;
+    }
+
+    block* allocate() {
+      for(; cursor < words; ++cursor) {
+        const std::uint64_t free = ~used[cursor];
+        if(!free) continue;
+
+        const std::size_t bit = __builtin_ctzll(free);
+        const std::size_t index = cursor * 64 + bit;
+        if(index >= capacity) break;
+
+        used[cursor] |= 1ul << bit;
+        return reinterpret_cast<block*>(data() + index * object);
+      }
+
+      return nullptr;
+    }
+
+    // marked object count
+    std::size_t live() const {
+      std::size_t res = 0;
+      for(std::size_t i = 0; i < words; ++i) {
+        res += __builtin_popcountll(marks[i]);
+      }
+      return res;
+    }
+
+    bool empty() const {
+      return std::all_of(used, used + words, [](std::uint64_t w) { return !w; });
+    }
     
-public:
+    // free unmarked objects and clear marks
+    void sweep() {
+      for(std::size_t i = 0; i < words; ++i) {
+        if(destroy) {
+          for(std::uint64_t dead = used[i] & ~marks[i]; dead; dead &= dead - 1) {
+            const std::size_t index = i * 64 + __builtin_ctzll(dead);
+            destroy(reinterpret_cast<block*>(data() + index * object));
+          }
+        }
+
+        used[i] = marks[i];
+        marks[i] = 0;
+      }
+
+      cursor = 0;
+    }
+
+    static void* operator new(std::size_t) {
+      // note: over-allocate then trim to get aligned pages
+      char* ptr = static_cast<char*>(::mmap(nullptr, 2 * size, PROT_READ | PROT_WRITE,
+                                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+      if(ptr == MAP_FAILED) throw std::bad_alloc();
+
+      char* res = reinterpret_cast<char*>((std::uintptr_t(ptr) + size - 1) & ~(size - 1));
+      if(res > ptr) ::munmap(ptr, res - ptr);
+      ::munmap(res + size, ptr + size - res);
+      return res;
+    }
+
+    static void operator delete(void* ptr) {
+      ::munmap(ptr, size);
+    }
+  };
+
+  // pages left to sweep after a major collection. pages are claimed one by
+  // one, either by the background sweeper or by the allocator before reusing
+  // them
+  struct job {
+    enum : std::uint8_t { waiting, busy, done };
     
+    const std::vector<page*> pages;
+    const std::unique_ptr<std::atomic<std::uint8_t>[]> states;
+
+    job(std::vector<page*> pages):
+      pages(std::move(pages)),
+      states(new std::atomic<std::uint8_t>[this->pages.size()]) {
+      for(std::size_t i = 0, n = this->pages.size(); i < n; ++i) {
+        states[i].store(waiting, std::memory_order_relaxed);
+      }
+    }
+
+    // sweep page unless claimed already, true when page is swept
+    bool sweep(std::size_t index) {
+      std::uint8_t expected = states[index].load(std::memory_order_acquire);
+      if(expected != waiting) return expected == done;
+      
+      if(states[index].compare_exchange_strong(expected, busy, std::memory_order_acquire)) {
+        pages[index]->sweep();
+        states[index].store(done, std::memory_order_release);
+        return true;
+      }
+
+      return expected == done;
+    }
+
+    void wait(std::size_t index) const {
+      while(states[index].load(std::memory_order_acquire) != done) {
+        std::this_thread::yield();
+      }
+    }
+
+    // note: only touches pages it claimed, so that pages may be released once
+    // all are swept even though the job is still queued
+    void run() {
+      for(std::size_t i = 0, n = pages.size(); i < n; ++i) {
+        sweep(i);
+      }
+    }
+  };
+
+  // background thread running sweep jobs, shared by all heaps
+  class sweeper {
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::shared_ptr<job>> jobs;
+    bool stop = false;
+
+    // note: started last
+    std::thread thread;
+
+    sweeper(): thread([this] { loop(); }) { }
+
+    void loop() {
+      for(;;) {
+        std::shared_ptr<job> next;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          wake.wait(lock, [&] { return stop || !jobs.empty(); });
+          if(stop) return;
+
+          next = std::move(jobs.front());
+          jobs.pop_front();
+        }
+
+        next->run();
+      }
+    }
+
+  public:
+    ~sweeper() {
+      {
+        const std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+      }
+      wake.notify_one();
+      thread.join();
+    }
+
+    static sweeper& instance() {
+      static sweeper res;
+      return res;
+    }
+
+    void post(std::shared_ptr<job> self) {
+      {
+        const std::lock_guard<std::mutex> lock(mutex);
+        jobs.emplace_back(std::move(self));
+      }
+      wake.notify_one();
+    }
+  };
+  
+  // pages for a given type and size class
+  struct pool {
+    std::vector<page*> pages;
+
+    // first page possibly holding free slots
+    std::size_t current = 0;
+  };
+
+  // objects larger than the largest size class
+  struct alignas(granularity) large {
+    large* next;
+    destroy_type destroy;
+    std::size_t type;
+
+    block* get() { return reinterpret_cast<block*>(this + 1); }
+  };
+
+  // dense type ids for pool lookup, with type info for statistics
+  static std::vector<const std::type_info*>& infos() {
+    static std::vector<const std::type_info*> res;
+    return res;
+  }
+
+  static std::mutex& infos_mutex() {
+    static std::mutex res;
+    return res;
+  }
+  
+  static std::size_t types(const std::type_info& info) {
+    const std::lock_guard<std::mutex> lock(infos_mutex());
+    infos().emplace_back(&info);
+    return infos().size() - 1;
+  }
+
+  static const std::type_info& info(std::size_t type) {
+    const std::lock_guard<std::mutex> lock(infos_mutex());
+    return *infos()[type];
+  }
+  
+  template<class T>
+  static std::size_t type() {
+    static const std::size_t res = types(typeid(T));
+    return res;
+  }
+
+  // note: marks are set atomically so that objects may be marked in
+  // parallel, returns true when object was not marked
+  static bool set_mark(block* self) {
+    if(self->flags & block::large) {
+      return !(__atomic_fetch_or(&self->flags, block::marked, __ATOMIC_RELAXED)
+               & block::marked);
+    } else {
+      page* p = page::of(self);
+      const std::size_t index = p->index(self);
+      const std::uint64_t bit = 1ul << (index % 64);
+      return !(__atomic_fetch_or(&p->marks[index / 64], bit, __ATOMIC_RELAXED) & bit);
+    }
+  }
+
+  static bool get_mark(const block* self) {
+    if(self->flags & block::large) {
+      return __atomic_load_n(&self->flags, __ATOMIC_RELAXED) & block::marked;
+    } else {
+      const page* p = page::of(self);
+      const std::size_t index = p->index(self);
+      return __atomic_load_n(&p->marks[index / 64], __ATOMIC_RELAXED)
+        & (1ul << (index % 64));
+    }
+  }
+
+public:
+
+  struct count {
+    std::size_t objects = 0;
+    std::size_t bytes = 0;
+  };
+  
   template<class T>
   class ref {
     using ptr_type = managed<T>*;
@@ -59,8 +368,9 @@ public:
     T& operator*() const { return ptr->value; }
     T* operator->() const { return get();}
 
-    inline void mark() { ptr->set_mark(true); }
-    inline bool marked() const { return ptr->get_mark(); }
+    // true when newly marked
+    inline bool mark() { return set_mark(ptr); }
+    inline bool marked() const { return get_mark(ptr); }
 
     friend std::ostream& operator<<(std::ostream& out, const ref& self) {
       return out << self.get();
@@ -68,28 +378,365 @@ public:
   };
 
 
+  // object heap: allocation and collection state. heaps are independent
+  // from each other so that separate threads may use separate heaps
+  class heap {
+    // old generation: pools indexed by type and size class, then large
+    // objects
+    std::vector<pool> pools;
+    large* first = nullptr;
+
+    // bytes allocated in old generation since last sweep
+    std::size_t allocated = 0;
+
+    // pages not yet swept since last sweep, if any
+    std::shared_ptr<job> sweeping;
+
+    // young generation: objects are bump-allocated in chunks, the first one
+    // being kept across minor collections
+    const std::size_t nursery;
+    std::vector<char*> chunks;
+    char* top = nullptr;
+    char* limit = nullptr;
+
+    // young objects to destroy unless promoted
+    std::vector<std::pair<block*, destroy_type>> finalizers;
+
+    // young objects allocated, and promoted since last flip
+    count allocations, promotions;
+
+    template<class T>
+    void* allocate_old(std::size_t size) {
+      if(size > max_class) {
+        allocated += size;
+        large* res = static_cast<large*>(::operator new(sizeof(large) + size));
+        res->next = first;
+        res->destroy = destructor<T>();
+        res->type = type<T>();
+        first = res;
+        return res->get();
+      }
+
+      const std::size_t index = (size + granularity - 1) / granularity - 1;
+      const std::size_t slot = type<T>() * classes + index;
+      if(slot >= pools.size()) {
+        pools.resize(slot + 1);
+      }
+
+      const std::size_t object = (index + 1) * granularity;
+      allocated += object;
+
+      pool& p = pools[slot];
+      for(; p.current < p.pages.size(); ++p.current) {
+        page* it = p.pages[p.current];
+        
+        // note: pages being swept in the background are skipped until next
+        // collection
+        if(!swept(it)) continue;
+        if(block* res = it->allocate()) return res;
+      }
+
+      p.pages.emplace_back(new page(std::max(object, min_class), destructor<T>()));
+      return p.pages.back()->allocate();
+    }
+
+    // sweep page first when needed, false when being swept by someone else
+    bool swept(page* it) {
+      if(!sweeping || it->ticket >= sweeping->pages.size()) return true;
+      return sweeping->sweep(it->ticket);
+    }
+
+    // free unmarked large objects and clear marks, returning live size
+    std::size_t sweep_large() {
+      std::size_t live = 0;
+      
+      large** it = &first;
+      while(*it) {
+        block* obj = (*it)->get();
+        if(!(obj->flags & block::marked)) {
+          large* dead = *it;
+          *it = dead->next;
+          if(dead->destroy) dead->destroy(obj);
+          ::operator delete(dead);
+        } else {
+          obj->flags &= ~block::marked;
+          live += obj->size;
+          it = &(*it)->next;
+        }
+      }
+
+      return live;
+    }
+    
+    void* allocate_young(std::size_t size) {
+      if(size > std::size_t(limit - top)) {
+        // note: oversized objects get their own chunk
+        char* chunk = static_cast<char*>(::operator new(std::max(nursery, size)));
+        chunks.emplace_back(chunk);
+        top = chunk;
+        limit = chunk + std::max(nursery, size);
+      }
+
+      void* res = top;
+      top += size;
+      return res;
+    }
+
+  public:
+    // collection is requested once more than `budget` bytes were allocated
+    // in the old generation since last sweep. the budget is then adjusted to
+    // the live heap size
+    static constexpr std::size_t min_budget = 1ul << 20;
+    std::size_t budget = min_budget;
+
+    // young chunk size, zero when objects are directly allocated in the old
+    // generation. only owners able to update all references to promoted
+    // objects may enable the young generation
+    heap(std::size_t nursery=0): nursery(nursery) { }
+
+    heap(const heap&) = delete;
+
+    ~heap() {
+      finish();
+      flip();
+
+      // note: nothing is marked
+      for(pool& p: pools) {
+        for(page* it: p.pages) {
+          it->sweep();
+          delete it;
+        }
+      }
+      sweep_large();
+
+      if(!chunks.empty()) {
+        ::operator delete(chunks[0]);
+      }
+    }
+
+    // allocate object followed by `extra` bytes of trailing storage,
+    // starting right after the object itself. note: never collects, owners
+    // poll `pending()` at safe points instead
+    template<class T, class ... Args>
+    ref<T> make_ref_extra(std::size_t extra, Args&& ... args) {
+      static_assert(sizeof(managed<T>) == sizeof(block) + sizeof(T),
+                    "trailing storage must follow object");
+      static_assert(alignof(managed<T>) <= alignof(block), "alignment error");
+
+      // note: keep young objects aligned
+      const std::size_t size = (sizeof(managed<T>) + extra + alignof(block) - 1)
+        & ~(alignof(block) - 1);
+
+      if(!nursery) {
+        managed<T>* res = new (allocate_old<T>(size)) managed<T>(std::forward<Args>(args)...);
+        res->size = size;
+        if(size > max_class) res->flags = block::large;
+        return {res};
+      }
+
+      managed<T>* res = new (allocate_young(size)) managed<T>(std::forward<Args>(args)...);
+      res->size = size;
+      res->flags = block::young;
+
+      ++allocations.objects;
+      allocations.bytes += size;
+
+      if(destroy_type destroy = destructor<T>()) {
+        finalizers.emplace_back(res, destroy);
+      }
+
+      return {res};
+    }
+
+    // young generation overflowed its first chunk, or old generation
+    // exhausted its budget
+    bool pending() const {
+      return chunks.size() > 1 || allocated > budget;
+    }
+
+    bool exhausted() const {
+      return allocated > budget;
+    }
+
+    // copy young object to the old generation on first call, then return its
+    // forwarding address
+    template<class T>
+    ref<T> promote(const ref<T>& self) {
+      if(block* res = self.ptr->forward) {
+        return {static_cast<managed<T>*>(res)};
+      }
+
+      managed<T>* res = self.ptr->relocate(allocate_old<T>(self.ptr->size));
+      if(res->size > max_class) res->flags = block::large;
+
+      ++promotions.objects;
+      promotions.bytes += res->size;
+      
+      self.ptr->forward = res;
+      return {res};
+    }
+
+    // release young generation once survivors have been promoted
+    void flip() {
+      for(const auto& it: finalizers) {
+        if(!it.first->forward) it.second(it.first);
+      }
+      finalizers.clear();
+      allocations = promotions = {};
+      
+      if(chunks.empty()) return;
+
+      std::for_each(chunks.begin() + 1, chunks.end(), [](char* chunk) {
+          ::operator delete(chunk);
+        });
+      chunks.resize(1);
+
+      top = chunks[0];
+      limit = top + nursery;
+    }
+
+    // sweep old generation once marked: large objects right away, pages
+    // lazily, in the background or when the allocator reaches them
+    void sweep() {
+      std::size_t live = sweep_large();
+      
+      std::vector<page*> pages;
+      for(pool& p: pools) {
+        for(page* it: p.pages) {
+          it->ticket = pages.size();
+          pages.emplace_back(it);
+          live += it->live() * it->object;
+        }
+        p.current = 0;
+      }
+
+      allocated = 0;
+      budget = std::max(min_budget, live);
+
+      if(pages.empty()) return;
+      sweeping = std::make_shared<job>(std::move(pages));
+      sweeper::instance().post(sweeping);
+    }
+
+    // young objects allocated since last flip
+    const count& allocated_young() const { return allocations; }
+
+    // young objects promoted since last flip
+    const count& promoted_young() const { return promotions; }
+
+    // old generation objects by type: `func(info, count)` is called for each
+    // page and large object. marked objects are counted between marking and
+    // sweep, allocated ones when no sweep is pending
+    template<class Func>
+    void census(Func func, bool marked=false) const {
+      for(std::size_t i = 0, n = pools.size(); i < n; ++i) {
+        if(pools[i].pages.empty()) continue;
+        const std::type_info& type = info(i / classes);
+
+        for(const page* it: pools[i].pages) {
+          count c;
+          for(std::size_t j = 0; j < page::words; ++j) {
+            c.objects += __builtin_popcountll(marked ? it->marks[j] : it->used[j]);
+          }
+          
+          c.bytes = c.objects * it->object;
+          func(type, c);
+        }
+      }
+
+      for(large* it = first; it; it = it->next) {
+        const block* obj = it->get();
+        if(marked && !(obj->flags & block::marked)) continue;
+        func(info(it->type), count{1, obj->size});
+      }
+    }
+    
+    // complete pending sweep and release empty pages. must be called before
+    // marking
+    void finish() {
+      if(!sweeping) return;
+
+      for(std::size_t i = 0, n = sweeping->pages.size(); i < n; ++i) {
+        if(!sweeping->sweep(i)) sweeping->wait(i);
+      }
+      sweeping.reset();
+      
+      for(pool& p: pools) {
+        auto end = std::remove_if(p.pages.begin(), p.pages.end(), [&](page* it) {
+            if(!it->empty()) return false;
+            delete it;
+            return true;
+          });
+
+        p.pages.erase(end, p.pages.end());
+        p.current = 0;
+      }
+    }
+  };
+
+
+  // heap used for allocation by the calling thread: a thread-local default
+  // heap unless a scope is active
+  static heap& current() {
+    if(heap* res = active) return *res;
+
+    static thread_local heap fallback;
+    return fallback;
+  }
+
+  class scope {
+    heap* const saved;
+  public:
+    scope(heap& self): saved(active) { active = &self; }
+    ~scope() { active = saved; }
+  };
+
+
   template<class T, class ... Args>
   static ref<T> make_ref(Args&& ... args) {
-    return {new managed<T>(std::forward<Args>(args)...)};
+    return current().template make_ref_extra<T>(0, std::forward<Args>(args)...);
   }
 
-  static void sweep() {
-    block** it = &first;
-    while(*it) {
-      if(!(*it)->get_mark()) {
-        block* obj = *it;
-        *it = (*it)->next.ptr;
-        delete obj;
-      } else {
-        (*it)->set_mark(false);
-        it = &(*it)->next.ptr;
-      }
-    }
+  template<class T, class ... Args>
+  static ref<T> make_ref_extra(std::size_t extra, Args&& ... args) {
+    return current().template make_ref_extra<T>(extra, std::forward<Args>(args)...);
   }
+
+
+  template<class T>
+  static bool young(const ref<T>& self) {
+    return self.ptr->flags & block::young;
+  }
+
+  template<class T>
+  static bool promoted(const ref<T>& self) {
+    return self.ptr->forward;
+  }
+
+  // write barrier: true when an old object is first mutated since last minor
+  // collection, in which case the owner must scan it during next minor
+  // collection
+  template<class T>
+  static bool remember(const ref<T>& self) {
+    if(self.ptr->flags & (block::young | block::remembered)) return false;
+    self.ptr->flags |= block::remembered;
+    return true;
+  }
+
+  template<class T>
+  static void forget(const ref<T>& self) {
+    self.ptr->flags &= ~block::remembered;
+  }
+
+private:
+  static thread_local heap* active;
 };
 
 template<class Tag>
-typename gc<Tag>::block* gc<Tag>::first = nullptr;
+constexpr std::size_t gc<Tag>::heap::min_budget;
+
+template<class Tag>
+thread_local typename gc<Tag>::heap* gc<Tag>::active = nullptr;
 
 
 #endif
@@ -0,0 +1,130 @@
+#ifndef SLIP_HASH_MAP_HPP
+#define SLIP_HASH_MAP_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// open addressing hash map for small keys (symbols, pointers), iterated in
+// insertion order: entries are stored densely, and found through a
+// power-of-two index of entry positions probed linearly. note: entries are
+// never erased, and insertion invalidates references to entries
+template<class Key, class Value, class Hash=std::hash<Key>>
+class hash_map {
+public:
+  // note: keys must not be modified through iterators
+  using value_type = std::pair<Key, Value>;
+  using iterator = typename std::vector<value_type>::iterator;
+  using const_iterator = typename std::vector<value_type>::const_iterator;
+
+private:
+  std::vector<value_type> entries;
+
+  // entry positions plus one, zero for empty slots
+  std::vector<std::uint32_t> index;
+  std::size_t shift = 0;
+
+  // note: fibonacci hashing, so that dense ids and aligned pointers spread
+  // evenly
+  std::size_t slot(const Key& key) const {
+    return (std::uint64_t(Hash()(key)) * 0x9e3779b97f4a7c15ul) >> shift;
+  }
+
+  // index slot holding key, or empty slot where it belongs
+  std::size_t probe(const Key& key) const {
+    const std::size_t mask = index.size() - 1;
+    for(std::size_t i = slot(key); ; i = (i + 1) & mask) {
+      const std::uint32_t pos = index[i];
+      if(!pos || entries[pos - 1].first == key) return i;
+    }
+  }
+
+  void rehash(std::size_t size) {
+    index.assign(size, 0);
+    shift = 64 - __builtin_ctzll(size);
+
+    const std::size_t mask = size - 1;
+    for(std::size_t pos = 0, n = entries.size(); pos < n; ++pos) {
+      std::size_t i = slot(entries[pos].first);
+      while(index[i]) i = (i + 1) & mask;
+      index[i] = pos + 1;
+    }
+  }
+
+public:
+  hash_map() = default;
+
+  template<class Iterator>
+  hash_map(Iterator first, Iterator last) {
+    insert(first, last);
+  }
+
+  hash_map(std::initializer_list<value_type> init):
+    hash_map(init.begin(), init.end()) { }
+
+  iterator begin() { return entries.begin(); }
+  iterator end() { return entries.end(); }
+
+  const_iterator begin() const { return entries.begin(); }
+  const_iterator end() const { return entries.end(); }
+
+  std::size_t size() const { return entries.size(); }
+  bool empty() const { return entries.empty(); }
+
+  iterator find(const Key& key) {
+    if(index.empty()) return end();
+    const std::uint32_t pos = index[probe(key)];
+    return pos ? begin() + (pos - 1) : end();
+  }
+
+  const_iterator find(const Key& key) const {
+    if(index.empty()) return end();
+    const std::uint32_t pos = index[probe(key)];
+    return pos ? begin() + (pos - 1) : end();
+  }
+
+  std::size_t count(const Key& key) const {
+    return find(key) != end();
+  }
+
+  // construct value in place unless key is present
+  template<class ... Args>
+  std::pair<iterator, bool> emplace(const Key& key, Args&& ... args) {
+    // note: load factor stays below 1/2
+    if(2 * (entries.size() + 1) > index.size()) {
+      rehash(std::max<std::size_t>(8, 2 * index.size()));
+    }
+
+    const std::size_t i = probe(key);
+    if(index[i]) return {begin() + (index[i] - 1), false};
+
+    entries.emplace_back(std::piecewise_construct,
+                         std::forward_as_tuple(key),
+                         std::forward_as_tuple(std::forward<Args>(args)...));
+    index[i] = entries.size();
+    return {end() - 1, true};
+  }
+
+  Value& operator[](const Key& key) {
+    return emplace(key).first->second;
+  }
+
+  template<class Iterator>
+  void insert(Iterator first, Iterator last) {
+    for(; first != last; ++first) {
+      emplace(first->first, first->second);
+    }
+  }
+
+  void clear() {
+    entries.clear();
+    index.clear();
+  }
+};
+
+
+#endif
@@ -37,6 +37,7 @@ namespace type {
       vars(make_ref<vars_type>(parent->vars)),
       sigs(parent->sigs),
       sub(parent->sub),
+      types(parent->types),
       debug(parent->debug)
   {
 
@@ -184,6 +185,9 @@ namespace type {
   
   // rewrite app as nested unary applications
   static ast::app rewrite(const ast::app& self) {
+    // note: keep unary applications as is so that function nodes are shared
+    if(self.args && !self.args->tail) return self;
+    
     const ast::expr& init = *self.func;
 
     // turn nullary applications into unary applications
@@ -407,6 +411,28 @@ namespace type {
   static mono infer(const ref<state>& s, const ast::app& self) {
     // normalize application as unary
     const ast::app rw = rewrite(self);
+    if(self.args && self.args->tail) {
+      const mono ret = infer(s, rw);
+
+      // note: the rewritten function node is a copy, record its type for the
+      // original one as well (type-directed compilation)
+      if(s->types) {
+        const ast::app* inner = &rw;
+        for(std::size_t i = 1, n = size(self.args); i < n; ++i) {
+          inner = &inner->func->cast<ast::app>();
+        }
+
+        auto it = s->types->find(inner->func.get());
+        if(it != s->types->end()) {
+          const mono func = it->second;
+          auto res = s->types->emplace(self.func.get(), func);
+          if(!res.second) res.first->second = func;
+        }
+      }
+      
+      return ret;
+    }
+    
     assert(size(rw.args) == 1);
 
     const mono func = infer(s, *rw.func);
@@ -643,6 +669,13 @@ namespace type {
         std::throw_with_nested(error(ss.str()));
     }
 
+    // record the provided type as the module type (type-directed
+    // compilation)
+    if(s->types) {
+      auto it = s->types->emplace(self.type.get(), provided);
+      if(!it.second) it.first->second = provided;
+    }
+    
     // now generalize the provided type
     const poly gen = sub->generalize(inner);
 
@@ -712,15 +745,31 @@ namespace type {
     const mono value = infer(s, *self.env);
 
     // make sure value type is a record
-    const mono row = s->fresh(kind::row());
-    s->unify(value, record(row));
+    const mono attrs = s->fresh(kind::row());
+    s->unify(value, record(attrs));
 
-    foldr_rows(true, s->sub->substitute(row), [&](symbol attr, mono t, bool) {
+    const mono known = s->sub->substitute(attrs);
+
+    mono tail = known;
+    while(auto ext = tail.get<app>()) {
+      tail = extension::unpack(*ext).tail;
+    }
+    
+    // note: later extensions of an open row are not bound, hence the fresh tail
+    const mono bound = foldr_rows(tail == empty ? empty : mono(s->fresh(kind::row())), known,
+                                  [&](symbol attr, mono t, mono rhs) {
         // TODO generalization issue?
         s->def(attr, t);
-        return true;
+        return row(attr, t) |= rhs;
       });
 
+    // record bound attributes as the environment type (type-directed
+    // compilation)
+    if(s->types) {
+      auto it = s->types->emplace(self.env.get(), record(bound));
+      if(!it.second) it.first->second = record(bound);
+    }
+
     const mono a = s->fresh();
     return io(a)(unit);
   }
@@ -942,7 +991,12 @@ namespace type {
 
   mono infer(const ref<state>& s, const ast::expr& self) {
     try {
-      return self.visit(infer_visitor(), s);
+      const mono res = self.visit(infer_visitor(), s);
+      if(s->types) {
+        auto it = s->types->emplace(&self, res);
+        if(!it.second) it.first->second = res;
+      }
+      return res;
     } catch(error& e) {
       std::stringstream ss;
       ss << "when processing expression: " << tool::show(self);
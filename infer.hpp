@@ -24,6 +24,12 @@ namespace type {
     
     const ref<substitution> sub;
 
+    // inferred expression types by ast node, only recorded when non-null
+    // (type-directed compilation). note: nodes are keyed by address, so
+    // entries are only meaningful until the expression is released
+    using types_type = std::map<const ast::expr*, mono>;
+    ref<types_type> types;
+    
     state();
     state(const ref<state>& parent);
 
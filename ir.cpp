@@ -2,6 +2,10 @@
 
 #include "ast.hpp"
 #include "tool.hpp"
+#include "maybe.hpp"
+
+#include "infer.hpp"
+#include "substitution.hpp"
 
 #include <algorithm>
 
@@ -9,37 +13,61 @@
 
 namespace ir {
 
-  closure::closure(std::size_t argc, vector<expr> captures, block body)
+  closure::closure(std::size_t argc, vector<expr> captures, block body,
+                   bool lifted)
     : argc(argc),
       captures(captures),
-      body(body) { }
+      body(body),
+      lifted(lifted) { }
 
   
   struct state {
-    const state* parent = nullptr;
+    const state* parent;
+
+    // inferred types, if any
+    const type::state* types;
+
+    // known builtins, if any
+    const builtin_type* builtin;
+
+    // stack size in current frame (locals + temporaries)
+    std::size_t depth = 0;
     
-    using locals_type = std::map<symbol, local>;
+    using locals_type = hash_map<symbol, local>;
     locals_type locals;
     
-    std::map<symbol, capture> captures;
+    hash_map<symbol, capture> captures;
 
+    // allocate next stack slot for name
     state& def(symbol name);
     
     expr find(symbol name);
 
+    // whether name is bound in this scope or an enclosing one
+    bool bound(symbol name) const;
+
     // currently defined value, if any
     const symbol* self = nullptr;
+
+    state(const state* parent = nullptr, const type::state* types = nullptr,
+          const builtin_type* builtin = nullptr):
+      parent(parent),
+      types(types),
+      builtin(parent ? parent->builtin : builtin) { }
     
     struct scope {
       state* owner;
       locals_type locals;
-
+      std::size_t depth;
+      
       scope(state* owner):
         owner(owner),
-        locals(owner->locals) { }
+        locals(owner->locals),
+        depth(owner->depth) { }
 
       ~scope() {
         owner->locals = std::move(locals);
+        owner->depth = depth;
       }
     };
     
@@ -48,8 +76,10 @@ namespace ir {
   
   
   state& state::def(symbol name) {
-    auto info = locals.emplace(name, locals.size());
-    (void) info; assert(info.second);
+    // note: shadows any previous definition
+    auto info = locals.emplace(name, depth);
+    if(!info.second) info.first->second = depth;
+    ++depth;
     return *this;
   }
   
@@ -64,15 +94,78 @@ namespace ir {
     if(cap != captures.end()) return cap->second;
 
     // add capture
-    if(parent) {
+    if(parent && parent->bound(name)) {
       return captures.emplace(name, captures.size()).first->second;
     } else {
+      // note: globals are never captured so that closures see redefinitions
       return global{name};
     }
   }
 
 
+  bool state::bound(symbol name) const {
+    return locals.find(name) != locals.end()
+      || captures.find(name) != captures.end()
+      || (parent && parent->bound(name));
+  }
+
+
+
+  // inferred type for ast node `self`, if recorded
+  static maybe<type::mono> inferred(const state* ctx, const ast::expr* self) {
+    if(!ctx->types || !ctx->types->types) return {};
+
+    auto it = ctx->types->types->find(self);
+    if(it == ctx->types->types->end()) return {};
+
+    return ctx->types->sub->substitute(it->second);
+  }
+
+
+  // attribute labels of a row type, empty unless the row is closed (when
+  // `closed` is set)
+  static vector<symbol> labels(type::mono row, bool closed) {
+    vector<symbol> res;
+    while(auto ext = row.get<type::app>()) {
+      const auto e = type::extension::unpack(*ext);
+      res.emplace_back(e.attr);
+      row = e.tail;
+    }
+
+    if(closed && row != type::empty) return {};
+    return res;
+  }
+  
+
+  // row labels for function `self` of type `ctor(row) -> a` when the row is
+  // closed (record selection, sum matching), empty otherwise
+  static vector<symbol> closed_row(const state* ctx, const ast::expr* self) {
+    const maybe<type::mono> t = inferred(ctx, self);
+    if(!t) return {};
+    
+    const type::mono arg = t.get().cast<type::app>()->ctor.cast<type::app>()->arg;
+    return labels(arg.cast<type::app>()->arg, true);
+  }
 
+
+  // whether function type `self` is integer -> integer -> integer/boolean
+  static bool integer_op(type::mono self) {
+    for(std::size_t i = 0; i < 2; ++i) {
+      const auto to = self.get<type::app>();
+      if(!to) return false;
+      
+      const auto from = (*to)->ctor.get<type::app>();
+      if(!from || (*from)->ctor != type::func || (*from)->arg != type::integer) {
+        return false;
+      }
+
+      self = (*to)->arg;
+    }
+
+    return self == type::integer || self == type::boolean;
+  }
+
+  
   ////////////////////////////////////////////////////////////////////////////////
   static expr compile(state* ctx, ast::expr self);
   
@@ -93,25 +186,154 @@ namespace ir {
   }
 
   
+  // local holding attribute `attr` of scalar-replaced record `name`. note: not
+  // a valid identifier
+  static symbol field(symbol name, symbol attr) {
+    return symbol(std::string(name.get()) + "." + attr.get());
+  }
+
+  
+  // escape analysis: whether variable `name` only occurs in `self` as the
+  // argument of selections of `attrs`, and is never rebound (so that field
+  // locals cannot be shadowed)
+  static bool selected(symbol name, const vector<symbol>& attrs, const ast::expr& self) {
+    const auto rec = [&](const ast::expr& e) { return selected(name, attrs, e); };
+    
+    return self.match([&](const ast::expr& ) { return true; },
+      [&](const ast::var& self) { return self.name != name; },
+      [&](const ast::app& self) {
+        if(auto s = self.func->get<ast::sel>()) {
+          auto v = self.args->head.get<ast::var>();
+          if(v && v->name == name) {
+            return std::find(attrs.begin(), attrs.end(), s->id.name) != attrs.end();
+          }
+        }
+        
+        if(!rec(*self.func)) return false;
+        for(const ast::expr& arg: self.args) {
+          if(!rec(arg)) return false;
+        }
+        return true;
+      },
+      [&](const ast::abs& self) {
+        for(const ast::abs::arg& arg: self.args) {
+          if(arg.name() == name) return false;
+        }
+        return rec(*self.body);
+      },
+      [&](const ast::let& self) {
+        for(const ast::bind& def: self.defs) {
+          if(def.id.name == name || !rec(def.value)) return false;
+        }
+        return rec(*self.body);
+      },
+      [&](const ast::cond& self) {
+        return rec(*self.test) && rec(*self.conseq) && rec(*self.alt);
+      },
+      [&](const ast::record& self) {
+        for(const ast::record::attr& attr: self.attrs) {
+          if(!rec(attr.value)) return false;
+        }
+        return true;
+      },
+      [&](const ast::match& self) {
+        for(const ast::match::handler& h: self.cases) {
+          if(h.arg.name() == name || !rec(h.value)) return false;
+        }
+        return !self.fallback || rec(*self.fallback);
+      },
+      [&](const ast::make& self) {
+        for(const ast::record::attr& attr: self.attrs) {
+          if(!rec(attr.value)) return false;
+        }
+        return rec(*self.type);
+      },
+      [&](const ast::def& self) {
+        return self.id.name != name && rec(*self.value);
+      },
+      [&](const ast::import& self) { return self.package != name; },
+      [&](const ast::run& self) { return rec(*self.value); },
+      [&](const ast::seq& self) {
+        for(const ast::io& io: self.items) {
+          const bool ok = io.match([&](const ast::bind& self) {
+              return self.id.name != name && rec(self.value);
+            },
+            [&](const ast::expr& self) { return rec(self); });
+          if(!ok) return false;
+        }
+        return rec(*self.last);
+      },
+      // note: conservative, as both may bind arbitrary names
+      [&](const ast::use& ) { return false; },
+      [&](const ast::module& ) { return false; });
+  }
+
+
+  // let-bound record literal that does not escape the let (see `selected`),
+  // with its attributes
+  static maybe<vector<symbol>> scalar(const ast::let& self, const ast::bind& def) {
+    const ast::record* rec = def.value.get<ast::record>();
+    if(!rec) return {};
+    
+    vector<symbol> attrs;
+    for(const ast::record::attr& attr: rec->attrs) {
+      attrs.emplace_back(attr.id.name);
+    }
+
+    for(const ast::bind& other: self.defs) {
+      if(!selected(def.id.name, attrs, other.value)) return {};
+    }
+    
+    if(!selected(def.id.name, attrs, *self.body)) return {};
+    return attrs;
+  }
+  
+  
   static expr compile(state* ctx, ast::let self) {
     const state::scope backup(ctx);
+
+    // note: non-escaping records are scalar-replaced, each attribute getting
+    // its own local. other records, sums and closures are heap-allocated
+    std::vector<maybe<vector<symbol>>> scalars;
+    for(ast::bind def : self.defs) {
+      scalars.emplace_back(scalar(self, def));
+    }
     
     // allocate space for variables
+    const std::size_t start = ctx->depth;
+    auto it = scalars.begin();
     for(ast::bind def : self.defs) {
-      ctx->def(def.id.name);
+      if(const maybe<vector<symbol>>& attrs = *it++) {
+        for(symbol attr: attrs.get()) {
+          ctx->def(field(def.id.name, attr));
+        }
+      } else {
+        ctx->def(def.id.name);
+      }
     }
-
+    
     // push defined values
     vector<expr> items;
+    ctx->depth = start;
+    it = scalars.begin();
     for(ast::bind def : self.defs) {
+      if(*it++) {
+        for(const ast::record::attr& attr: def.value.get<ast::record>()->attrs) {
+          items.emplace_back(compile(ctx, attr.value));
+          ++ctx->depth;
+        }
+        continue;
+      }
+      
       // TODO exception safety
       ctx->self = &def.id.name;
       ir::expr value = compile(ctx, def.value);
       ctx->self = nullptr;
 
       items.emplace_back(std::move(value));
+      ++ctx->depth;
     }
-    const std::size_t locals = items.size();
+    const std::size_t locals = ctx->depth - start;
     
     // compile let body
     items.emplace_back(compile(ctx, *self.body));
@@ -121,8 +343,42 @@ namespace ir {
   }
 
   
+  // mark calls in tail position
+  static expr tail(const expr& self) {
+    return self.match([&](const expr& self) { return self; },
+      [&](const call& self) -> expr {
+        return call{self.argc, true};
+      },
+      [&](const block& self) -> expr {
+        if(self.items.empty()) return self;
+        
+        auto last = self.items.end() - 1;
+
+        // note: scope exit is skipped by tail calls
+        if(last->get<exit>() && last != self.items.begin()) --last;
+        
+        vector<expr> items;
+        for(auto it = self.items.begin(), end = self.items.end(); it != end; ++it) {
+          items.emplace_back(it == last ? tail(*it) : *it);
+        }
+        
+        return block{std::move(items)};
+      },
+      [&](const ref<branch>& self) -> expr {
+        return make_ref<branch>(tail(self->then), tail(self->alt));
+      },
+      [&](const ref<match>& self) -> expr {
+        match::cases_type cases;
+        for(const auto& it: self->cases) {
+          cases.emplace(it.first, tail(it.second));
+        }
+        return make_ref<match>(std::move(cases), tail(self->fallback), self->row);
+      });
+  }
+  
+  
   static expr compile(state* ctx, ast::abs self) {
-    state sub = {ctx};
+    state sub(ctx, ctx->types);
 
     // allocate stack for function arguments
     for(auto arg : self.args) {
@@ -148,52 +404,196 @@ namespace ir {
 
     // body block
     vector<expr> items;
-    items.emplace_back(body);
+    items.emplace_back(tail(body));
     
     return make_ref<closure>(size(self.args), captures, block{std::move(items)});
   }
 
   
+  // integer builtin called by name, either as a global variable or as a
+  // (package) attribute
+  static maybe<prim> intrinsic(state* ctx, const ast::app& self) {
+    static const std::map<symbol, prim> table = {
+      {"+", {prim::add, "+"}},
+      {"-", {prim::sub, "-"}},
+      {"*", {prim::mul, "*"}},
+      {"=", {prim::eq, "="}},
+      {"<", {prim::lt, "<"}},
+      {"<=", {prim::le, "<="}},
+      {">", {prim::gt, ">"}},
+      {">=", {prim::ge, ">="}},
+    };
+
+    if(self.argc != 2) return {};
+
+    // note: when types are known, only integer operations are specialised
+    const maybe<type::mono> t = inferred(ctx, self.func.get());
+    if(t && !integer_op(t.get())) return {};
+
+    // callee global and attribute, if any
+    maybe<symbol> callee, attr;
+    
+    const symbol* name = self.func->match([&](const ast::expr& ) -> const symbol* {
+        return nullptr;
+      },
+      [&](const ast::var& func) -> const symbol* {
+        if(!ctx->find(func.name).get<global>()) return nullptr;
+        callee = func.name;
+        return &func.name;
+      },
+      [&](const ast::app& func) -> const symbol* {
+        auto sel = func.func->get<ast::sel>();
+        if(!sel) return nullptr;
+
+        auto v = func.args->head.get<ast::var>();
+        if(v && !ctx->bound(v->name)) {
+          callee = v->name;
+          attr = sel->id.name;
+        }
+        
+        return &sel->id.name;
+      });
+
+    if(!name) return {};
+
+    auto it = table.find(*name);
+    if(it == table.end()) return {};
+
+    prim res = it->second;
+    res.guarded = !(t && callee && ctx->builtin && (*ctx->builtin)(callee.get(), attr));
+    return res;
+  }
+  
+  
   static expr compile(state* ctx, ast::app self) {
     return self.func->match([&](const ast::expr& func) -> expr {
+        const std::size_t depth = ctx->depth;
         vector<expr> items;
 
+        const maybe<prim> op = intrinsic(ctx, self);
+        
         // push func
-        items.emplace_back(compile(ctx, func));
-
+        if(!op || op.get().guarded) {
+          items.emplace_back(compile(ctx, func));
+          ++ctx->depth;
+        }
+        
         // push args
         std::size_t argc = 0;
         for(ast::expr arg : self.args) {
           items.emplace_back(compile(ctx, arg));
+          ++ctx->depth;
           ++argc;
         };
 
         // call
-        items.emplace_back(call{argc});
+        if(op) {
+          items.emplace_back(op.get());
+        } else {
+          items.emplace_back(call{argc});
+        }
+        ctx->depth = depth;
 
         return block{std::move(items)};
       },
       
       [&](const ast::sel& func) -> expr {
         assert(size(self.args) == 1);
+
+        // scalar-replaced record
+        if(auto v = self.args->head.get<ast::var>()) {
+          const symbol name = field(v->name, func.id.name);
+          if(ctx->bound(name)) return ctx->find(name);
+        }
+
+        // record literal: push attributes and keep the selected one
+        if(auto rec = self.args->head.get<ast::record>()) {
+          maybe<std::size_t> index;
+          std::size_t i = 0;
+          for(const ast::record::attr& attr: rec->attrs) {
+            if(attr.id.name == func.id.name) index = i;
+            ++i;
+          }
+
+          if(index) {
+            const std::size_t depth = ctx->depth;
+            vector<expr> items;
+            for(const ast::record::attr& attr: rec->attrs) {
+              items.emplace_back(compile(ctx, attr.value));
+              ++ctx->depth;
+            }
+            ctx->depth = depth;
+
+            items.emplace_back(local{depth + index.get()});
+            items.emplace_back(exit{i});
+            return block{std::move(items)};
+          }
+        }
+        
+        vector<expr> items;
+        items.emplace_back(compile(ctx, self.args->head));
+        items.emplace_back(sel{func.id.name, closed_row(ctx, self.func.get())});
+
+        return block{std::move(items)};
+      },
+      [&](const ast::inj& func) -> expr {
+        assert(size(self.args) == 1);
         vector<expr> items;
         items.emplace_back(compile(ctx, self.args->head));
-        items.emplace_back(sel{func.id.name});
+        items.emplace_back(inj{func.id.name});
 
         return block{std::move(items)};
       },
       [&](const ast::match& func) -> expr {
-        std::map<symbol, expr> cases;
+        assert(size(self.args) == 1);
+        vector<expr> items;
+
+        // injection: data is matched statically
+        if(auto app = self.args->head.get<ast::app>()) {
+          auto inj = app->func->get<ast::inj>();
+          if(inj && size(app->args) == 1) {
+            const state::scope backup(ctx);
+            items.emplace_back(compile(ctx, app->args->head));
+
+            for(ast::match::handler h: func.cases) {
+              if(h.id.name != inj->id.name) continue;
+              
+              ctx->def(h.arg.name());
+              items.emplace_back(compile(ctx, h.value));
+              items.emplace_back(exit{1});
+              return block{std::move(items)};
+            }
+
+            ++ctx->depth;
+            items.emplace_back(func.fallback ? compile(ctx, *func.fallback) : lit<unit>{});
+            items.emplace_back(exit{1});
+            return block{std::move(items)};
+          }
+        }
+        
+        
+        // push matched value
+        items.emplace_back(compile(ctx, self.args->head));
+        
+        match::cases_type cases;
         for(ast::match::handler h: func.cases) {
           const state::scope backup(ctx);
 
-          // reserve stack for matched variable
+          // matched value slot holds sum data
           ctx->def(h.arg.name());
           
           expr c = compile(ctx, h.value);
           cases.emplace(h.id.name, c);
         }
-        return make_ref<match>(std::move(cases), compile(ctx, func.fallback));
+
+        // note: unreachable for sealed sums
+        ++ctx->depth;
+        const expr fallback = func.fallback ? compile(ctx, *func.fallback) : lit<unit>{};
+        --ctx->depth;
+        
+        items.emplace_back(make_ref<match>(std::move(cases), fallback,
+                                           closed_row(ctx, self.func.get())));
+        return block{std::move(items)};
       });
   }
 
@@ -208,49 +608,133 @@ namespace ir {
   
 
   static expr compile(state* ctx, ast::import self) {
-    // TODO differentiate between topleve/local imports
-    if(ctx->parent) {    
-      throw std::runtime_error("unimplemented: non-toplevel import");
+    vector<expr> items;
+    items.emplace_back(import{self.package});
+    
+    if(ctx->parent) {
+      // note: only bound in sequences
+      items.emplace_back(drop{});
+      items.emplace_back(lit<unit>{});
     } else {
-      vector<expr> items;
-      items.emplace_back(import{self.package});
       items.emplace_back(def{self.package});
-      return block{items};
     }
+    
+    return block{items};
   }
 
 
   static expr compile(state* ctx, ast::def self) {
+    vector<expr> items;
+    items.emplace_back(compile(ctx, *self.value));
+
     if(ctx->parent) {
-      throw std::runtime_error("unimplemented: non-toplevel def");
+      // note: only bound in sequences
+      items.emplace_back(drop{});
+      items.emplace_back(lit<unit>{});
     } else {
-      vector<expr> items;
-      items.emplace_back(compile(ctx, *self.value));
       items.emplace_back(def{self.id.name});
-      return block{items};
     }
+    
+    return block{items};
   }
 
-
   
   static expr compile(state* ctx, ast::use self) {
     if(ctx->parent) {
-      throw std::runtime_error("unimplemented: non-toplevel use");
-      // TODO get help from the type system?
+      // note: only bound in sequences
+      vector<expr> items;
+      items.emplace_back(compile(ctx, *self.env));
+      items.emplace_back(drop{});
+      items.emplace_back(lit<unit>{});
+      return block{items};
     } else {
       return make_ref<use>(compile(ctx, *self.env));
     }
   }
 
 
+  // sequence items: definitions, imports and uses bind new locals, other
+  // expressions are evaluated and dropped
+  static void compile(state* ctx, const ast::io& self, vector<expr>& items) {
+    self.match([&](const ast::bind& self) {
+        items.emplace_back(compile(ctx, self.value));
+        ctx->def(self.id.name);
+      },
+      [&](const ast::expr& self) {
+        self.match([&](const ast::expr& ) {
+            items.emplace_back(compile(ctx, self));
+            items.emplace_back(drop{});
+          },
+          [&](const ast::def& self) {
+            // note: definitions are recursive, as in let
+            const std::size_t slot = ctx->depth;
+            ctx->def(self.id.name);
+            ctx->depth = slot;
+            items.emplace_back(compile(ctx, *self.value));
+            ctx->depth = slot + 1;
+          },
+          [&](const ast::import& self) {
+            items.emplace_back(import{self.package});
+            ctx->def(self.package);
+          },
+          [&](const ast::use& self) {
+            // note: attributes bound during inference are recorded as the
+            // environment type
+            const maybe<type::mono> t = inferred(ctx, self.env.get());
+            if(!t) throw std::runtime_error("unimplemented: untyped local use");
+
+            const type::mono row = t.get().cast<type::app>()->arg;
+            const vector<symbol> closed = labels(row, true);
+
+            // environment is held in an anonymous slot
+            const std::size_t env = ctx->depth;
+            items.emplace_back(compile(ctx, *self.env));
+            ++ctx->depth;
+
+            for(symbol attr: labels(row, false)) {
+              items.emplace_back(local{env});
+              items.emplace_back(sel{attr, closed});
+              ctx->def(attr);
+            }
+          });
+      });
+  }
+  
+
+  static expr compile(state* ctx, ast::seq self) {
+    const state::scope backup(ctx);
+    const std::size_t start = ctx->depth;
+
+    vector<expr> items;
+    for(const ast::io& io: self.items) {
+      compile(ctx, io, items);
+    }
+
+    const std::size_t locals = ctx->depth - start;
+    items.emplace_back(compile(ctx, *self.last));
+    items.emplace_back(exit{locals});
+
+    return block{std::move(items)};
+  }
+
+
+  // note: computations are performed eagerly
+  static expr compile(state* ctx, ast::run self) {
+    return compile(ctx, *self.value);
+  }
+  
+
   static expr compile(state* ctx, ast::record self) {
+    const std::size_t depth = ctx->depth;
     vector<expr> items;
     vector<symbol> attrs;
 
     for(const ast::record::attr& attr: self.attrs) {
       attrs.emplace_back(attr.id.name);
       items.emplace_back(compile(ctx, attr.value));
+      ++ctx->depth;
     }
+    ctx->depth = depth;
     
     items.emplace_back(record{std::move(attrs)});
     return block{std::move(items)};
@@ -260,6 +744,44 @@ namespace ir {
   static expr compile(state* ctx, ast::match self) {
     throw std::runtime_error("unimplemented: naked match");
   }
+
+
+  // module creation: records for products, injections for coproducts. note:
+  // the provided type is recorded as the module type during inference
+  static expr compile(state* ctx, ast::make self) {
+    const maybe<type::mono> t = inferred(ctx, self.type.get());
+    if(!t) throw std::runtime_error("unimplemented: untyped make");
+
+    if(t.get().cast<type::app>()->ctor == type::record) {
+      return compile(ctx, ast::record{self.attrs});
+    }
+
+    assert(size(self.attrs) == 1);
+    const ast::record::attr& attr = self.attrs->head;
+    
+    vector<expr> items;
+    items.emplace_back(compile(ctx, attr.value));
+    items.emplace_back(inj{attr.id.name});
+    return block{std::move(items)};
+  }
+
+
+  // module definition: types are erased, the reified type constructor is
+  // never called
+  static expr compile(state*, ast::module) {
+    vector<expr> items;
+    items.emplace_back(lit<unit>{});
+    return make_ref<closure>(1, vector<expr>(), block{std::move(items)});
+  }
+
+
+  static expr compile(state*, ast::inj self) {
+    // build injection function
+    vector<expr> items;
+    items.emplace_back(local{0});
+    items.emplace_back(inj{self.id.name});
+    return make_ref<closure>(1, vector<expr>(), block{std::move(items)});
+  }
   
   
   ////////////////////////////////////////////////////////////////////////////////  
@@ -271,8 +793,9 @@ namespace ir {
 
   
 
-  expr compile(const ast::expr& self) {
-    state ctx;
+  expr compile(const ast::expr& self, const type::state* types,
+               const builtin_type& builtin) {
+    state ctx(nullptr, types, builtin ? &builtin : nullptr);
     return compile(&ctx, self);
   }
 
@@ -309,7 +832,7 @@ namespace ir {
     }
 
     sexpr operator()(const ref<closure>& self) const {
-      return symbol("closure")
+      return symbol(self->lifted ? "lifted" : "closure")
         >>= integer(self->argc)
         >>= foldr(sexpr::list(), self->captures,
                   [&](sexpr::list tail, ir::expr head) {
@@ -345,11 +868,24 @@ namespace ir {
     }
 
     sexpr operator()(const call& self) const {
-      return symbol("call")
+      return symbol(self.tail ? "tailcall" : "call")
         >>= integer(self.argc)
         >>= sexpr::list();
     }
 
+    sexpr operator()(const direct& self) const {
+      return symbol(self.tail ? "taildirect" : "direct")
+        >>= self.name
+        >>= integer(self.argc)
+        >>= sexpr::list();
+    }
+
+    sexpr operator()(const prim& self) const {
+      return symbol(self.guarded ? "prim" : "unguarded")
+        >>= self.name
+        >>= sexpr::list();
+    }
+
     sexpr operator()(const def& self) const {
       return symbol("def")
         >>= self.name
@@ -385,6 +921,13 @@ namespace ir {
     }
 
 
+    sexpr operator()(const inj& self) const {
+      return symbol("inj")
+        >>= self.tag
+        >>= sexpr::list();
+    }
+
+    
     sexpr operator()(const ref<match>& self) const {
       auto tail = sexpr::list();
 
@@ -8,7 +8,10 @@
 #include "symbol.hpp"
 #include "string.hpp"
 #include "vector.hpp"
+#include "hash_map.hpp"
+#include "maybe.hpp"
 
+#include <functional>
 #include <map>
 
 struct sexpr;
@@ -17,6 +20,10 @@ namespace ast {
   struct expr;
 }
 
+namespace type {
+  struct state;
+}
+
 namespace ir {
 
   struct expr;
@@ -69,20 +76,45 @@ namespace ir {
     std::size_t locals;
   };
   
-  // attribute selection
+  // attribute selection. row holds record attributes when statically known
+  // (closed record type), empty otherwise
   struct sel {
     symbol attr;
+    vector<symbol> row = {};
   };
 
   struct import {
     const symbol package;
   };
 
+  // tail calls reuse the caller frame
   struct call {
     std::size_t argc;
+    bool tail = false;
+  };
+
+  // saturated call to a global holding a closure of known arity: callee is
+  // pushed as for a call, but neither its type nor its arity are checked
+  struct direct {
+    symbol name;
+    std::size_t argc;
+    bool tail = false;
+  };
+
+  // binary call to an integer builtin, named after the callee attribute or
+  // global variable. note: guarded primitives push callee and arguments as
+  // for a call, and the call is only performed when callee is not the builtin
+  // at runtime. unguarded ones only push arguments (typed code calling a
+  // known builtin)
+  struct prim {
+    enum op_type { add, sub, mul, eq, lt, le, gt, ge };
+    op_type op;
+    symbol name;
+    bool guarded = true;
   };
   
-  // TODO this one needs help from the typechecker
+  // toplevel use: record attributes become globals. note: local uses bind
+  // slots instead, using inferred types
   struct use;
 
   
@@ -90,16 +122,21 @@ namespace ir {
     vector<symbol> attrs;
   };
 
+  // sum injection
+  struct inj {
+    symbol tag;
+  };
+
   
   struct expr : variant<lit<unit>, lit<boolean>, lit<integer>, lit<real>, lit<string>,
                         local, capture, global,
-                        call,
+                        call, direct, prim,
                         ref<closure>,
                         block, exit, drop, 
                         ref<branch>, ref<match>,
                         import, ref<use>,
                         def,
-                        sel, record> {
+                        sel, record, inj> {
     using expr::variant::variant;
   };
   
@@ -112,12 +149,16 @@ namespace ir {
   };
   
 
+  // lifted closures have no captures and are created once per enclosing
+  // code object (see lambda_lift)
   struct closure {
     const std::size_t argc;
     const vector<expr> captures;
     const block body;
+    const bool lifted;
 
-    closure(std::size_t argc, vector<expr> captures, block body);
+    closure(std::size_t argc, vector<expr> captures, block body,
+            bool lifted = false);
   };
 
   
@@ -131,19 +172,30 @@ namespace ir {
   };
 
   
+  // sum matching: the matched value is replaced with its data, which is
+  // visible to cases as a local variable. row holds sum tags when statically
+  // known (closed sum type), empty otherwise
   struct match {
-    using cases_type = std::map<symbol, expr>;
+    using cases_type = hash_map<symbol, expr>;
     const cases_type cases;
     const expr fallback;
-
-    match(cases_type cases, expr fallback):
+    const vector<symbol> row;
+    
+    match(cases_type cases, expr fallback, vector<symbol> row={}):
       cases(std::move(cases)),
-      fallback(fallback) { }
+      fallback(fallback),
+      row(std::move(row)) { }
   };
 
   
-  // toplevel compilation
-  expr compile(const ast::expr& self);
+  // whether global `name` (or attribute `attr` of the record it holds) is
+  // the integer builtin of the same name for good
+  using builtin_type = std::function<bool(symbol name, maybe<symbol> attr)>;
+  
+  // toplevel compilation, optionally using types recorded during inference.
+  // typed calls to known builtins are compiled to unguarded primitives
+  expr compile(const ast::expr& self, const type::state* types=nullptr,
+               const builtin_type& builtin={});
 
 
   // 
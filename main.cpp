@@ -1,5 +1,8 @@
+#include <algorithm>
 #include <map>
 #include <iostream>
+#include <string>
+#include <vector>
 #include <sstream>
 #include <fstream>
 
@@ -23,6 +26,7 @@
 #include "vm.hpp"
 #include "infer.hpp"
 #include "builtins.hpp"
+#include "stats.hpp"
 
 struct history {
   const std::string filename;
@@ -89,21 +93,55 @@ static std::string print_error(const std::exception& e, bool verbose=true,
 
 
 
+// rewrite -O<level> as --opt-level <level>, and --name=value as --name value
+static std::vector<std::string> normalize(int argc, const char** argv) {
+  std::vector<std::string> res;
+  for(int i = 0; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const std::size_t eq = arg.find('=');
+    
+    if(i && arg.size() > 2 && arg.compare(0, 2, "-O") == 0) {
+      res.emplace_back("--opt-level");
+      res.emplace_back(arg.substr(2));
+    } else if(i && arg.compare(0, 2, "--") == 0 && eq != std::string::npos) {
+      res.emplace_back(arg.substr(0, eq));
+      res.emplace_back(arg.substr(eq + 1));
+    } else {
+      res.emplace_back(arg);
+    }
+  }
+
+  return res;
+}
+
+
 int main(int argc, const char** argv) {
 
   using namespace argparse;
   const auto parser = argparse::parser()
-    .flag("debug-gc", "debug garbage collector")
+    .flag("gc-stats", "report garbage collections")
+    .option<std::string>("gc-json", "dump garbage collector statistics to file")
     .flag("debug-tc", "debug type checking")
     .flag("ast", "debug abstract syntax tree")
     .flag("time", "time evaluations")
     .flag("verbose", "be verbose")
     .flag("compile", "compile and evaluate intermediate representation")
+    .option<std::size_t>("opt-level", "optimization level, 0 to 2 (also -O<level>)")
+    .option<std::size_t>("inline-threshold", "inline functions up to this size (0 disables)")
+    .flag("time-passes", "report time spent in optimization passes")
+    .option<std::string>("dump-ir-after", "dump intermediate representation after pass")
+    .flag("verify-ir", "check intermediate representation after each pass")
     .flag("help", "show help")
     .argument<std::string>("filename", "file to run")
     ;
   
-  const auto options = parser.parse(argc, argv);
+  const std::vector<std::string> args = normalize(argc, argv);
+  std::vector<const char*> ptrs;
+  for(const std::string& arg: args) {
+    ptrs.emplace_back(arg.c_str());
+  }
+  
+  const auto options = parser.parse(ptrs.size(), ptrs.data());
   if(options.flag("help", false)) {
     parser.describe(std::cout);
     return 0;
@@ -124,15 +162,68 @@ int main(int argc, const char** argv) {
   
   // expression evaluate
   std::function<printer_type(ast::expr)> evaluate;
+
+  // garbage collector statistics
+  const bool gc_stats = options.flag("gc-stats", false);
+  const auto gc_json = options.get<std::string>("gc-json");
+  
+  stats::heap vm_stats("vm"), eval_stats("eval");
+  if(gc_stats) vm_stats.log = &std::clog;
+
+  std::function<stats::census()> vm_census = [] { return stats::census(); };
+
+  // optimization pass timings
+  std::map<std::string, double> pass_times;
   
   if(options.flag("compile", false)) {
+    // note: inferred types drive compilation
+    ts->types = make_ref<type::state::types_type>();
+    
+    ir::options opts;
+    if(auto level = options.get<std::size_t>("opt-level")) opts.level = *level;
+    if(auto threshold = options.get<std::size_t>("inline-threshold")) {
+      opts.inline_threshold = *threshold;
+    }
+    
+    opts.verify = options.flag("verify-ir", opts.verify);
+    if(options.flag("time-passes", false)) opts.times = &pass_times;
+    
+    if(auto dump = options.get<std::string>("dump-ir-after")) {
+      const auto& passes = ir::passes();
+      if(std::none_of(passes.begin(), passes.end(), [&](const ir::pass& p) {
+            return *dump == p.name;
+          })) {
+        std::cerr << "unknown pass: " << *dump << std::endl;
+        return 1;
+      }
+      opts.dump = *dump;
+    }
+    
     auto state = make_ref<vm::state>();
-    evaluate = [state](ast::expr e) {
-      const ir::expr c = ir::compile(e);
+    vm::pipeline(state.get(), opts);
+    
+    if(gc_stats || gc_json) {
+      vm::monitor(state.get(), &vm_stats);
+      vm_census = [state] { return vm::census(state.get()); };
+    }
+    
+    evaluate = [state, ts, opts](ast::expr e) {
+      const ir::builtin_type builtin = [&](symbol name, maybe<symbol> attr) {
+        return state->primitive(name, attr);
+      };
+      
+      const ir::expr c = ir::compile(e, ts.get(), builtin);
       // std::clog << "compiled: " << repr(c) << std::endl;
+
+      const ir::arity_type arity = [&](symbol name) {
+        return state->arity(name);
+      };
+
+      const ir::callee_type callee = [&](symbol name, maybe<symbol> attr) {
+        return state->inlinable(name, attr);
+      };
       
-      const ir::expr o = ir::opt(c);
-      // std::clog << "optimized: " << repr(o) << std::endl;
+      const ir::expr o = ir::optimize(c, {opts, arity, callee});
       return make_printer(vm::eval(state.get(), o));
     };
   } else {
@@ -197,6 +288,7 @@ int main(int argc, const char** argv) {
         }
         
         const auto print = evaluate(e);
+        if(ts->types) ts->types->clear();
         std::cout << " : " << p << std::flush;
         
         print(std::cout << " = ");
@@ -206,9 +298,34 @@ int main(int argc, const char** argv) {
   };
 
   
+  const auto report = [&] {
+    for(const ir::pass& p: ir::passes()) {
+      auto it = pass_times.find(p.name);
+      if(it == pass_times.end()) continue;
+      std::clog << "pass " << p.name << ": " << it->second * 1000 << "ms" << std::endl;
+    }
+    
+    if(!gc_stats && !gc_json) return;
+    
+    vm_stats.live = vm_census();
+    eval_stats.live = eval::census();
+
+    if(gc_stats) {
+      stats::summary(std::clog, vm_stats);
+      stats::summary(std::clog, eval_stats);
+    }
+
+    if(gc_json) {
+      std::ofstream out(gc_json->c_str());
+      stats::json(out, {&vm_stats, &eval_stats});
+    }
+  };
+  
   if(auto filename = options.get<std::string>("filename")) {
     if(auto ifs = std::ifstream(filename->c_str())) {
-      return reader(ifs) ? 0 : 1;
+      const bool ok = reader(ifs);
+      report();
+      return ok ? 0 : 1;
     } else {
       std::cerr << "io error: " << "cannot open file " << *filename << std::endl;
       return 1;
@@ -228,6 +345,7 @@ int main(int argc, const char** argv) {
     }
     
     read_loop(reader);
+    report();
   }
   
   return 0;
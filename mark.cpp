@@ -0,0 +1,95 @@
+#include "mark.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+
+namespace mark {
+
+  struct pool::impl {
+    std::vector<std::thread> threads;
+
+    // collection in progress
+    std::mutex busy;
+
+    std::mutex mutex;
+    std::condition_variable wake, done;
+
+    const std::function<void(std::size_t)>* task = nullptr;
+    std::size_t generation = 0;
+    std::size_t pending = 0;
+    bool stop = false;
+
+    void worker(std::size_t id) {
+      std::size_t seen = 0;
+      
+      for(;;) {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&] { return stop || generation != seen; });
+        if(stop) return;
+
+        seen = generation;
+        const auto* current = task;
+        lock.unlock();
+
+        (*current)(id);
+
+        lock.lock();
+        if(!--pending) done.notify_one();
+      }
+    }
+  };
+
+  
+  pool::pool(): self(new impl) {
+    // note: hardware_concurrency may be unknown
+    const std::size_t size = std::max(1u, std::thread::hardware_concurrency());
+    
+    for(std::size_t i = 1; i < size; ++i) {
+      self->threads.emplace_back([this, i] { self->worker(i); });
+    }
+  }
+
+  pool::~pool() {
+    {
+      const std::lock_guard<std::mutex> lock(self->mutex);
+      self->stop = true;
+    }
+    self->wake.notify_all();
+
+    for(std::thread& t: self->threads) {
+      t.join();
+    }
+  }
+
+  
+  pool& pool::instance() {
+    static pool res;
+    return res;
+  }
+
+  
+  std::size_t pool::size() const {
+    return self->threads.size() + 1;
+  }
+
+  
+  bool pool::run(const std::function<void(std::size_t)>& task) {
+    std::unique_lock<std::mutex> busy(self->busy, std::try_to_lock);
+    if(!busy) return false;
+
+    {
+      const std::lock_guard<std::mutex> lock(self->mutex);
+      self->task = &task;
+      self->pending = self->threads.size();
+      ++self->generation;
+    }
+    self->wake.notify_all();
+
+    task(0);
+
+    std::unique_lock<std::mutex> lock(self->mutex);
+    self->done.wait(lock, [&] { return !self->pending; });
+    return true;
+  }
+  
+}
@@ -0,0 +1,192 @@
+#ifndef SLIP_MARK_HPP
+#define SLIP_MARK_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+namespace mark {
+
+  // marker threads, shared by all heaps
+  class pool {
+    struct impl;
+    std::unique_ptr<impl> self;
+
+    pool();
+  public:
+    ~pool();
+
+    static pool& instance();
+
+    // worker count, including calling thread
+    std::size_t size() const;
+
+    // run task on all workers, the calling thread being worker 0. returns
+    // false without running anything when the pool is busy with another
+    // collection
+    bool run(const std::function<void(std::size_t)>& task);
+  };
+
+
+  // mark graph from roots using explicit mark stacks: `trace(item, push)` must
+  // push the children of `item` it marked first. workers trace from private
+  // stacks, sharing chunks of them when other workers run out of work
+  template<class Item>
+  class work {
+    static constexpr std::size_t chunk = 256;
+
+    // shared chunks of a worker
+    struct alignas(64) queue {
+      std::mutex mutex;
+      std::vector<std::vector<Item>> chunks;
+      std::atomic<std::size_t> size{0};
+    };
+
+    // note: plain new[] ignores queue alignment before c++17
+    struct release {
+      std::size_t size;
+
+      void operator()(queue* queues) const {
+        for(std::size_t i = 0; i < size; ++i) {
+          queues[i].~queue();
+        }
+        std::free(queues);
+      }
+    };
+
+    static queue* allocate(std::size_t size) {
+      void* block = nullptr;
+      if(posix_memalign(&block, alignof(queue), size * sizeof(queue))) {
+        throw std::bad_alloc();
+      }
+
+      queue* res = static_cast<queue*>(block);
+      for(std::size_t i = 0; i < size; ++i) {
+        new (res + i) queue;
+      }
+      return res;
+    }
+
+    const std::size_t workers;
+    std::unique_ptr<queue[], release> queues;
+    std::atomic<std::size_t> idle{0};
+
+    work(std::size_t workers):
+      workers(workers),
+      queues(allocate(workers), release{workers}) { }
+
+    void share(std::size_t id, std::vector<Item>& local) {
+      const std::size_t size = std::min(chunk, local.size() / 2);
+      std::vector<Item> items(local.end() - size, local.end());
+      local.erase(local.end() - size, local.end());
+
+      queue& q = queues[id];
+      const std::lock_guard<std::mutex> lock(q.mutex);
+      q.chunks.emplace_back(std::move(items));
+      ++q.size;
+    }
+
+    // take a chunk from own queue first, then steal from others
+    bool take(std::size_t id, std::vector<Item>& local) {
+      for(std::size_t i = 0; i < workers; ++i) {
+        queue& q = queues[(id + i) % workers];
+        if(!q.size.load(std::memory_order_relaxed)) continue;
+
+        const std::lock_guard<std::mutex> lock(q.mutex);
+        if(q.chunks.empty()) continue;
+
+        local = std::move(q.chunks.back());
+        q.chunks.pop_back();
+        --q.size;
+        return true;
+      }
+
+      return false;
+    }
+
+    bool empty() const {
+      for(std::size_t i = 0; i < workers; ++i) {
+        if(queues[i].size.load(std::memory_order_relaxed)) return false;
+      }
+      return true;
+    }
+
+    template<class Trace>
+    void drain(std::size_t id, Trace& trace) {
+      std::vector<Item> local;
+      const auto push = [&](const Item& item) { local.emplace_back(item); };
+
+      for(;;) {
+        while(!local.empty()) {
+          const Item item = local.back();
+          local.pop_back();
+          trace(item, push);
+
+          if(local.size() > 1 && idle.load(std::memory_order_relaxed)) {
+            share(id, local);
+          }
+        }
+
+        if(take(id, local)) continue;
+
+        // note: work may only be shared by busy workers, so that all workers
+        // being idle means marking is done
+        ++idle;
+        for(;;) {
+          if(!empty()) {
+            --idle;
+            if(take(id, local)) break;
+            ++idle;
+          }
+
+          if(idle.load() == workers) return;
+          std::this_thread::yield();
+        }
+      }
+    }
+
+  public:
+
+    template<class Trace>
+    static void run(std::vector<Item> roots, Trace trace, bool parallel) {
+      pool& p = pool::instance();
+      work self(parallel ? p.size() : 1);
+
+      // spread roots over workers
+      for(std::size_t i = 0; i < roots.size(); i += chunk) {
+        queue& q = self.queues[(i / chunk) % self.workers];
+        q.chunks.emplace_back(roots.begin() + i,
+                              roots.begin() + std::min(roots.size(), i + chunk));
+        ++q.size;
+      }
+
+      if(self.workers == 1) {
+        return self.drain(0, trace);
+      }
+      
+      if(p.run([&](std::size_t id) { self.drain(id, trace); })) {
+        return;
+      }
+
+      // pool busy: mark alone
+      work alone(1);
+      for(std::size_t i = 0; i < self.workers; ++i) {
+        for(auto& c: self.queues[i].chunks) {
+          alone.queues[0].chunks.emplace_back(std::move(c));
+          ++alone.queues[0].size;
+        }
+      }
+
+      alone.drain(0, trace);
+    }
+  };
+
+}
+
+#endif
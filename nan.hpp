@@ -133,7 +133,7 @@ namespace nan {
               return func(reinterpret_cast<const T&>(payload), std::forward<Args>(args)...);
             }...};
 
-          const index_type index = tag | (sign << 4);
+          const index_type index = tag | (sign << 3);
           return table[index](payload, func, std::forward<Args>(args)...);
         });
     }
@@ -148,6 +148,24 @@ namespace nan {
 
     variant(const variant& other): storage(other.storage) { }    
 
+    // same representation: tag and payload, or double bits
+    bool same(const variant& other) const {
+      const auto& lhs = storage.bits;
+      const auto& rhs = other.storage.bits;
+      return lhs.sign == rhs.sign && lhs.exponent == rhs.exponent &&
+        lhs.quiet == rhs.quiet && lhs.tag == rhs.tag && lhs.payload == rhs.payload;
+    }
+
+    // type index (only meaningful for non-double values)
+    index_type type() const {
+      return storage.bits.tag | (storage.bits.sign << 3);
+    }
+
+    template<class U, index_type index=helper_type::index((const U*)0)>
+    bool is() const {
+      return storage.bits.exponent == ieee754::nan && type() == index;
+    }
+    
     template<class U, index_type index=helper_type::index((const U*)0)>
     U cast() const {
       if(std::is_same<U, double>::value) {
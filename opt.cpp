@@ -2,10 +2,19 @@
 
 #include "ir.hpp"
 #include "repr.hpp"
+#include "sexpr.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
 
 namespace ir {
 
   struct map_visitor {
+    // whether closure bodies are mapped
+    bool nested = true;
 
     template<class Func>
     expr operator()(const expr& self, const Func& func) const {
@@ -26,7 +35,8 @@ namespace ir {
 
     template<class Func>
     expr operator()(const ref<closure>& self, const Func& func) const {
-
+      if(!nested) return func(self);
+      
       vector<expr> captures; captures.reserve(self->captures.size());
       for(const expr& c: self->captures) {
         captures.emplace_back(c.visit(*this, func));
@@ -42,7 +52,7 @@ namespace ir {
         });
       
       return func(make_ref<closure>(self->argc, std::move(captures),
-                                    block{std::move(items)}));
+                                    block{std::move(items)}, self->lifted));
     }
 
     
@@ -54,14 +64,39 @@ namespace ir {
 
       return func(make_ref<branch>(std::move(then), std::move(alt)));
     }
+
+
+    template<class Func>    
+    expr operator()(const ref<match>& self, const Func& func) const {
+      match::cases_type cases;
+      for(const auto& it: self->cases) {
+        cases.emplace(it.first, it.second.visit(*this, func));
+      }
+
+      expr fallback = self->fallback.visit(*this, func);
+      return func(make_ref<match>(std::move(cases), std::move(fallback), self->row));
+    }
+
+    
+    template<class Func>    
+    expr operator()(const ref<use>& self, const Func& func) const {
+      return func(make_ref<use>(self->env.visit(*this, func)));
+    }
   };
   
   
   // map an optimization pass recursively
-  static expr map(const expr& self, expr (*pass)(const expr&)) {
+  template<class Func>
+  static expr map(const expr& self, const Func& pass) {
     return self.visit(map_visitor(), pass);
   };
 
+  // map an optimization pass recursively, except in closure bodies
+  template<class Func>
+  static expr map_toplevel(const expr& self, const Func& pass) {
+    return self.visit(map_visitor{false}, pass);
+  };
+
 
   // flatten nested blocks
   static expr flatten_blocks(const block& self) {
@@ -90,10 +125,833 @@ namespace ir {
   }
   
   
-  // optimize expression
-  expr opt(const expr& self) {
-    return map(self, flatten_blocks);
+
+
+  // closure definitions: block holding a closure followed by its def
+  static void definitions(std::map<symbol, std::size_t>& res, const expr& self) {
+    if(const block* b = self.get<block>()) {
+      const std::size_t n = b->items.size();
+      for(std::size_t i = 0; i + 1 < n; ++i) {
+        const auto c = b->items[i].get<ref<closure>>();
+        const auto d = b->items[i + 1].get<def>();
+        if(c && d) res[d->name] = (*c)->argc;
+      }
+
+      for(const expr& e: b->items) {
+        definitions(res, e);
+      }
+    }
+  }
+
+  
+  expr direct_calls(const expr& self, const arity_type& arity) {
+    // note: a definition is only trusted when it does not change the arity of
+    // an existing global, as earlier code in `self` may still call the latter
+    std::map<symbol, std::size_t> defs;
+    definitions(defs, self);
+
+    const auto known = [&](symbol name) -> maybe<std::size_t> {
+      const maybe<std::size_t> current = arity(name);
+      auto it = defs.find(name);
+      if(it == defs.end()) return current;
+      if(current && current.get() != it->second) return {};
+      return it->second;
+    };
+    
+    return map(self, [&](const expr& self) -> expr {
+        // calls are compiled as blocks: callee, arguments then call
+        const block* b = self.get<block>();
+        if(!b || b->items.size() < 2) return self;
+
+        const call* c = b->items.back().get<call>();
+        if(!c || b->items.size() != c->argc + 2) return self;
+        
+        const global* g = b->items.front().get<global>();
+        if(!g) return self;
+
+        const maybe<std::size_t> argc = known(g->name);
+        if(!argc || argc.get() != c->argc) return self;
+
+        vector<expr> items;
+        for(std::size_t i = 0, n = c->argc + 1; i < n; ++i) {
+          items.emplace_back(b->items[i]);
+        }
+        
+        items.emplace_back(direct{g->name, c->argc, c->tail});
+        return block{std::move(items)};
+      });
   }
   
-}
 
+
+  expr lambda_lift(const expr& self) {
+    const auto lift = [&](const expr& self) -> expr {
+      const ref<closure>* c = self.get<ref<closure>>();
+      if(!c || !(*c)->captures.empty() || (*c)->lifted) return self;
+
+      return make_ref<closure>((*c)->argc, (*c)->captures, (*c)->body, true);
+    };
+
+    // note: toplevel closures are created once anyway, only nested ones are
+    // lifted
+    return map_toplevel(self, [&](const expr& self) -> expr {
+        const ref<closure>* c = self.get<ref<closure>>();
+        if(!c) return self;
+
+        const expr body = map(block{(*c)->body}, lift);
+        return make_ref<closure>((*c)->argc, (*c)->captures,
+                                 body.match([&](const expr& self) {
+                                     return block{vector<expr>(1, self)};
+                                   },
+                                   [&](const block& self) {
+                                     return self;
+                                   }),
+                                 (*c)->lifted);
+      });
+  }
+  
+
+
+  // stack effect of an expression, in values
+  static long effect(const expr& self) {
+    return self.match([&](const expr& ) -> long {
+        // literals, variables, closures, imports and uses
+        return 1;
+      },
+      [&](const block& self) {
+        long res = 0;
+        for(const expr& e: self.items) {
+          res += effect(e);
+        }
+        return res;
+      },
+      [&](const call& self) { return -long(self.argc); },
+      [&](const direct& self) { return -long(self.argc); },
+      [&](const prim& self) -> long { return self.guarded ? -2 : -1; },
+      [&](const exit& self) { return -long(self.locals); },
+      [&](const drop& self) { return -long(self.count); },
+      [&](const record& self) { return 1 - long(self.attrs.size()); },
+      // note: branches pop their test, matches replace matched value
+      [&](const ref<branch>& ) -> long { return 0; },
+      [&](const ref<match>& ) -> long { return 0; },
+      [&](const def& ) -> long { return 0; },
+      [&](const sel& ) -> long { return 0; },
+      [&](const inj& ) -> long { return 0; });
+  }
+
+
+  // expression size, in ir nodes
+  static std::size_t cost(const expr& self) {
+    std::size_t res = 0;
+    map(self, [&](const expr& self) {
+        res += !self.get<block>();
+        return self;
+      });
+    return res;
+  }
+
+
+  // whether expression refers to globals, closure bodies included
+  static bool globals(const expr& self) {
+    bool res = false;
+    map(self, [&](const expr& self) {
+        res = res || self.get<global>() || self.get<direct>() || self.get<def>();
+        return self;
+      });
+    return res;
+  }
+  
+
+  // move an inlined body into its caller frame: locals are shifted by
+  // `offset`, tail calls are kept only when the call site was one
+  struct relocate {
+    std::size_t offset;
+    bool tail;
+
+    expr operator()(const expr& self) const {
+      return self.match([&](const expr& self) { return self; },
+        [&](const local& self) -> expr { return local{self.index + offset}; },
+        [&](const call& self) -> expr { return call{self.argc, self.tail && tail}; },
+        [&](const direct& self) -> expr {
+          return direct{self.name, self.argc, self.tail && tail};
+        },
+        [&](const ref<closure>& self) -> expr {
+          // note: captures are evaluated in the caller frame, bodies are not
+          vector<expr> captures;
+          for(const expr& c: self->captures) {
+            captures.emplace_back(map_toplevel(c, *this));
+          }
+          
+          return make_ref<closure>(self->argc, std::move(captures), self->body,
+                                   self->lifted);
+        });
+    }
+  };
+
+  
+  // reach globals of an inlined body through package record `package`
+  static expr qualify(const expr& self, symbol package) {
+    return map(self, [&](const expr& self) {
+        return self.match([&](const expr& self) { return self; },
+          [&](const global& self) -> expr {
+            return block{{global{package}, sel{self.name}}};
+          },
+          [&](const direct& self) -> expr {
+            return call{self.argc, self.tail};
+          });
+      });
+  }
+  
+  
+  // whether expression refers to global `name`, closure bodies included
+  static bool refers(const expr& self, symbol name) {
+    bool res = false;
+    map(self, [&](const expr& self) {
+        const global* g = self.get<global>();
+        const direct* d = self.get<direct>();
+        res = res || (g && g->name == name) || (d && d->name == name);
+        return self;
+      });
+    return res;
+  }
+  
+
+  // note: locals are frame offsets, so that stack depth is tracked while
+  // visiting
+  struct inliner {
+    const callee_type& resolve;
+    const std::size_t threshold;
+
+    // static estimate of how often code runs: toplevel code runs once and
+    // is left alone, closure bodies count once, recursive definitions are
+    // assumed to loop, and each branch halves the estimate
+    const double frequency;
+    static constexpr double loop = 4;
+
+    // callee whose body is being inlined, and inliner of its call site
+    const closure* code;
+    const inliner* outer;
+
+    // note: bounds code growth through nested inlining
+    const std::size_t level;
+    static constexpr std::size_t max_level = 4;
+
+    inliner at(double frequency) const {
+      return {resolve, threshold, frequency, code, outer, level};
+    }
+    
+    expr operator()(const expr& self, std::size_t) const {
+      return self;
+    }
+    
+    expr operator()(const block& self, std::size_t depth) const {
+      vector<expr> items;
+      std::vector<std::size_t> depths;
+      
+      for(std::size_t i = 0, n = self.items.size(); i < n; ++i) {
+        const expr& e = self.items[i];
+        depths.emplace_back(depth);
+
+        const ref<closure>* c = e.get<ref<closure>>();
+        const def* d = i + 1 < n ? self.items[i + 1].get<def>() : nullptr;
+        if(c && d && refers(e, d->name)) {
+          items.emplace_back(lambda(*c, loop));
+        } else {
+          items.emplace_back(e.visit(*this, depth));
+        }
+        
+        depth += effect(e);
+        
+        if(e.get<call>() || e.get<direct>()) {
+          substitute(items, depths);
+        }
+      }
+
+      return block{std::move(items)};
+    }
+    
+    expr operator()(const ref<closure>& self, std::size_t) const {
+      return lambda(self, 1);
+    }
+
+    // closure with its body visited at `frequency`
+    expr lambda(const ref<closure>& self, double frequency) const {
+      const expr body = at(frequency)(self->body, self->argc);
+      return make_ref<closure>(self->argc, self->captures, body.cast<block>(),
+                               self->lifted);
+    }
+    
+    expr operator()(const ref<branch>& self, std::size_t depth) const {
+      // note: test is popped
+      const inliner sub = at(frequency / 2);
+      return make_ref<branch>(self->then.visit(sub, depth - 1),
+                              self->alt.visit(sub, depth - 1));
+    }
+
+    expr operator()(const ref<match>& self, std::size_t depth) const {
+      // note: matched value slot holds sum data
+      const inliner sub = at(frequency / 2);
+      
+      match::cases_type cases;
+      for(const auto& it: self->cases) {
+        cases.emplace(it.first, it.second.visit(sub, depth));
+      }
+
+      return make_ref<match>(std::move(cases), self->fallback.visit(sub, depth),
+                             self->row);
+    }
+
+    expr operator()(const ref<use>& self, std::size_t depth) const {
+      return make_ref<use>(self->env.visit(*this, depth));
+    }
+
+    // inline the call ending `items`, if possible. `depths` holds the stack
+    // depth before each item
+    void substitute(vector<expr>& items, std::vector<std::size_t>& depths) const;
+  };
+
+
+  void inliner::substitute(vector<expr>& items, std::vector<std::size_t>& depths) const {
+    const std::size_t n = items.size() - 1;
+    const std::size_t argc = items[n].match([](const expr& ) -> std::size_t { return 0; },
+                                            [](const call& self) { return self.argc; },
+                                            [](const direct& self) { return self.argc; });
+    const bool tail = items[n].match([](const expr& ) { return false; },
+                                     [](const call& self) { return self.tail; },
+                                     [](const direct& self) { return self.tail; });
+    
+    // callee: first item pushing argc + 1 values before the call, as
+    // argument code never pops values it did not push. note: calls may be
+    // flattened in callee bodies
+    std::size_t first = n;
+    long pushed = 0;
+    while(first > 0 && pushed < long(argc + 1)) {
+      pushed += effect(items[--first]);
+    }
+    if(pushed != long(argc + 1)) return;
+
+    // callee: global or package attribute
+    maybe<callee> target;
+    maybe<symbol> package;
+    std::size_t args = first + 1;
+    
+    if(const global* g = items[first].get<global>()) {
+      const sel* s = args < n ? items[args].get<sel>() : nullptr;
+      if(s) {
+        package = g->name;
+        target = resolve(g->name, s->attr);
+        ++args;
+      } else {
+        target = resolve(g->name, {});
+      }
+    } else if(const block* b = items[first].get<block>()) {
+      const global* g = b->items.size() == 2 ? b->items[0].get<global>() : nullptr;
+      const sel* s = g ? b->items[1].get<sel>() : nullptr;
+      if(s) {
+        package = g->name;
+        target = resolve(g->name, s->attr);
+      }
+    }
+    
+    if(!target || !target.get().code) return;
+
+    const ref<const closure>& code = target.get().code;
+    if(code->argc != argc || !code->captures.empty()) return;
+    if(cost(code->body) > threshold * frequency) return;
+
+    const callee::globals_type reach = target.get().globals;
+    if(reach == callee::foreign && globals(code->body)) return;
+    if(reach == callee::package && !package) return;
+
+    // note: recursive callees are not unrolled
+    if(level == max_level) return;
+    for(const inliner* it = this; it; it = it->outer) {
+      if(it->code == code.get()) return;
+    }
+
+    // note: a placeholder keeps the callee slot so that argument code is
+    // unchanged
+    const std::size_t depth = depths[first];
+    
+    vector<expr> res;
+    res.emplace_back(lit<unit>{});
+    for(std::size_t i = args; i < n; ++i) {
+      res.emplace_back(items[i]);
+    }
+
+    const expr body = map_toplevel(code->body, relocate{depth + 1, tail});
+    const inliner sub = {resolve, threshold, frequency, code.get(), this, level + 1};
+    res.emplace_back((reach == callee::package ? qualify(body, package.get()) : body)
+                     .visit(sub, depth + 1 + argc));
+    res.emplace_back(exit{argc + 1});
+
+    // note: exprs are not assignable
+    while(items.size() > first) {
+      items.pop_back();
+    }
+    depths.resize(first + 1);
+    items.emplace_back(block{std::move(res)});
+
+    if(target.get().pin) target.get().pin();
+  }
+
+  
+  expr inline_calls(const expr& self, const callee_type& callee, std::size_t threshold) {
+    if(!threshold) return self;
+    
+    const inliner visitor = {callee, threshold, 0, nullptr, nullptr, 0};
+    return self.visit(visitor, 0);
+  }
+
+
+  // rewrite uses of a record held by local (or capture) `index` once its
+  // attributes are pushed in its place: selections become variable accesses,
+  // and variables above it are shifted. other uses set `escapes`
+  struct scalar {
+    const vector<symbol>& attrs;
+    const bool captured;
+    const std::size_t index;
+    bool& escapes;
+
+    // whether `self` reads the record
+    bool reads(const expr& self) const {
+      if(captured) {
+        const capture* c = self.get<capture>();
+        return c && c->index == index;
+      }
+
+      const local* l = self.get<local>();
+      return l && l->index == index;
+    }
+
+    std::size_t shift(std::size_t i) const {
+      if(i == index) escapes = true;
+      return i > index ? i + attrs.size() - 1 : i;
+    }
+
+    expr access(std::size_t i) const {
+      if(captured) return capture{i};
+      return local{i};
+    }
+
+    expr operator()(const expr& self) const {
+      return self.match([&](const expr& self) { return self; },
+        [&](const local& self) -> expr {
+          return captured ? self : local{shift(self.index)};
+        },
+        [&](const capture& self) -> expr {
+          return captured ? capture{shift(self.index)} : self;
+        },
+        [&](const block& self) -> expr {
+          vector<expr> items;
+          for(std::size_t i = 0, n = self.items.size(); i < n; ++i) {
+            const sel* s = i + 1 < n ? self.items[i + 1].get<sel>() : nullptr;
+            if(!s || !reads(self.items[i])) {
+              items.emplace_back((*this)(self.items[i]));
+              continue;
+            }
+
+            const auto it = std::find(attrs.begin(), attrs.end(), s->attr);
+            if(it == attrs.end()) escapes = true;
+            items.emplace_back(access(index + (it - attrs.begin())));
+            ++i;
+          }
+          return block{std::move(items)};
+        },
+        [&](const ref<branch>& self) -> expr {
+          return make_ref<branch>((*this)(self->then), (*this)(self->alt));
+        },
+        [&](const ref<match>& self) -> expr {
+          match::cases_type cases;
+          for(const auto& it: self->cases) {
+            cases.emplace(it.first, (*this)(it.second));
+          }
+          return make_ref<match>(std::move(cases), (*this)(self->fallback),
+                                 self->row);
+        },
+        [&](const ref<use>& self) -> expr {
+          return make_ref<use>((*this)(self->env));
+        },
+        [&](const ref<closure>& self) -> expr {
+          // note: bodies only reach the record through captures, which
+          // capture its attributes instead
+          vector<expr> captures;
+          std::vector<std::size_t> expanded;
+          for(const expr& c: self->captures) {
+            if(!reads(c)) {
+              captures.emplace_back((*this)(c));
+              continue;
+            }
+
+            expanded.emplace_back(captures.size());
+            for(std::size_t i = 0, n = attrs.size(); i < n; ++i) {
+              captures.emplace_back(access(index + i));
+            }
+          }
+
+          return make_ref<closure>(self->argc, std::move(captures),
+                                   expand(self->body, expanded, 0),
+                                   self->lifted);
+        });
+    }
+
+    // rewrite closure body `self` for the record captures at `expanded`,
+    // from the `i`-th on. note: blocks are not assignable
+    block expand(const block& self, const std::vector<std::size_t>& expanded,
+                 std::size_t i) const {
+      if(i == expanded.size()) return self;
+      
+      const scalar sub = {attrs, true, expanded[i], escapes};
+      return expand(sub(self).cast<block>(), expanded, i + 1);
+    }
+  };
+
+
+  // note: locals are frame offsets, so that stack depth is tracked while
+  // visiting
+  struct replacer {
+    expr operator()(const expr& self, std::size_t) const {
+      return self;
+    }
+
+    static std::vector<std::size_t> depths(const vector<expr>& items, std::size_t depth) {
+      std::vector<std::size_t> res;
+      for(const expr& e: items) {
+        res.emplace_back(depth);
+        depth += effect(e);
+      }
+      return res;
+    }
+
+    expr operator()(const block& self, std::size_t depth) const {
+      vector<expr> items;
+      std::size_t i = 0;
+      for(std::size_t d: depths(self.items, depth)) {
+        items.emplace_back(self.items[i++].visit(*this, d));
+      }
+
+      // note: from last to first, so that earlier depths are unchanged
+      for(std::size_t i = items.size(); i-- > 0;) {
+        replace(items, i, depths(items, depth));
+      }
+
+      return block{std::move(items)};
+    }
+
+    expr operator()(const ref<closure>& self, std::size_t) const {
+      const expr body = (*this)(self->body, self->argc);
+      return make_ref<closure>(self->argc, self->captures, body.cast<block>(),
+                               self->lifted);
+    }
+
+    expr operator()(const ref<branch>& self, std::size_t depth) const {
+      // note: test is popped
+      return make_ref<branch>(self->then.visit(*this, depth - 1),
+                              self->alt.visit(*this, depth - 1));
+    }
+
+    expr operator()(const ref<match>& self, std::size_t depth) const {
+      match::cases_type cases;
+      for(const auto& it: self->cases) {
+        cases.emplace(it.first, it.second.visit(*this, depth));
+      }
+
+      return make_ref<match>(std::move(cases), self->fallback.visit(*this, depth),
+                             self->row);
+    }
+
+    expr operator()(const ref<use>& self, std::size_t depth) const {
+      return make_ref<use>(self->env.visit(*this, depth));
+    }
+
+    // scalar-replace the record built by `items[i]`, if it does not escape
+    // before an exit or drop pops it. `depths` holds the stack depth before
+    // each item
+    static void replace(vector<expr>& items, std::size_t i,
+                        const std::vector<std::size_t>& depths);
+  };
+
+
+  void replacer::replace(vector<expr>& items, std::size_t i,
+                         const std::vector<std::size_t>& depths) {
+    // record instruction, or block ending with one and pushing the record
+    const block* init = nullptr;
+    const record* rec = items[i].get<record>();
+    std::size_t slot = 0;
+    if(rec) {
+      if(depths[i] < rec->attrs.size()) return;
+      slot = depths[i] - rec->attrs.size();
+    } else if(const block* b = items[i].get<block>()) {
+      rec = b->items.empty() ? nullptr : b->items.back().get<record>();
+      if(!rec || effect(*b) != 1) return;
+
+      init = b;
+      slot = depths[i];
+    } else return;
+
+    const vector<symbol> attrs = rec->attrs;
+    if(attrs.empty()) return;
+
+    // first item popping the record slot: must be an exit or a drop, with
+    // the record below the result
+    const std::size_t n = items.size();
+    std::size_t last = i + 1;
+    for(; last < n; ++last) {
+      const std::size_t after = depths[last] + effect(items[last]);
+      if(items[last].get<drop>() ? after <= slot : after <= slot + 1) break;
+    }
+    if(last == n) return;
+
+    const exit* e = items[last].get<exit>();
+    const drop* d = items[last].get<drop>();
+    if(!d && !(e && slot + 1 < depths[last])) return;
+
+    vector<expr> uses;
+    for(std::size_t j = i + 1; j < last; ++j) {
+      uses.emplace_back(items[j]);
+    }
+
+    bool escapes = false;
+    const scalar rewrite = {attrs, false, slot, escapes};
+    const expr body = rewrite(block{std::move(uses)});
+    if(escapes) return;
+
+    const std::size_t extra = attrs.size() - 1;
+    const expr pop = e ? expr(exit{e->locals + extra}) : expr(drop{d->count + extra});
+
+    // note: `init` is popped below
+    vector<expr> values;
+    for(std::size_t j = 0, m = init ? init->items.size() - 1 : 0; j < m; ++j) {
+      values.emplace_back(init->items[j]);
+    }
+
+    vector<expr> tail;
+    while(items.size() > last + 1) {
+      tail.emplace_back(items.back());
+      items.pop_back();
+    }
+
+    // note: exprs are not assignable
+    while(items.size() > i) {
+      items.pop_back();
+    }
+
+    if(init) items.emplace_back(block{std::move(values)});
+    for(const expr& it: body.cast<block>().items) {
+      items.emplace_back(it);
+    }
+    items.emplace_back(pop);
+
+    while(!tail.empty()) {
+      items.emplace_back(tail.back());
+      tail.pop_back();
+    }
+  }
+
+
+  expr scalar_replace(const expr& self) {
+    return self.visit(replacer(), 0);
+  }
+
+
+
+  const std::vector<pass>& passes() {
+    static const std::vector<pass> res = {
+      {"lambda-lift", 1, [](const expr& self, const context& ) {
+          return lambda_lift(self);
+        }},
+      {"inline", 2, [](const expr& self, const context& ctx) {
+          return inline_calls(self, ctx.callee, ctx.opts.inline_threshold);
+        }},
+      {"scalar-replace", 2, [](const expr& self, const context& ) {
+          return scalar_replace(self);
+        }},
+      {"direct-calls", 1, [](const expr& self, const context& ctx) {
+          return direct_calls(self, ctx.arity);
+        }},
+      // note: last, as other passes match unflattened call blocks
+      {"flatten", 1, [](const expr& self, const context& ) {
+          return map(self, static_cast<expr (*)(const expr&)>(flatten_blocks));
+        }},
+    };
+
+    return res;
+  }
+
+  
+  // stack depth after an expression, starting from `depth`
+  struct verifier {
+    // capture count of the enclosing closure
+    const std::size_t captures;
+    
+    static void fail(const std::string& what) {
+      throw std::runtime_error("invalid ir: " + what);
+    }
+    
+    static void need(std::size_t depth, std::size_t count, const char* what) {
+      if(depth < count) fail(std::string("stack underflow in ") + what);
+    }
+
+    template<class T>
+    std::size_t operator()(const lit<T>& , std::size_t depth) const {
+      return depth + 1;
+    }
+
+    std::size_t operator()(const local& self, std::size_t depth) const {
+      if(self.index >= depth) fail("local out of frame");
+      return depth + 1;
+    }
+
+    std::size_t operator()(const capture& self, std::size_t depth) const {
+      if(self.index >= captures) fail("capture out of closure");
+      return depth + 1;
+    }
+
+    std::size_t operator()(const global& , std::size_t depth) const {
+      return depth + 1;
+    }
+
+    std::size_t operator()(const import& , std::size_t depth) const {
+      return depth + 1;
+    }
+    
+    std::size_t operator()(const call& self, std::size_t depth) const {
+      need(depth, self.argc + 1, "call");
+      return depth - self.argc;
+    }
+
+    std::size_t operator()(const direct& self, std::size_t depth) const {
+      need(depth, self.argc + 1, "direct call");
+      return depth - self.argc;
+    }
+
+    std::size_t operator()(const prim& self, std::size_t depth) const {
+      const std::size_t pushed = self.guarded ? 3 : 2;
+      need(depth, pushed, "primitive");
+      return depth - pushed + 1;
+    }
+
+    std::size_t operator()(const block& self, std::size_t depth) const {
+      for(const expr& e: self.items) {
+        depth = e.visit(*this, depth);
+      }
+      return depth;
+    }
+
+    std::size_t operator()(const exit& self, std::size_t depth) const {
+      need(depth, self.locals + 1, "exit");
+      return depth - self.locals;
+    }
+
+    std::size_t operator()(const drop& self, std::size_t depth) const {
+      need(depth, self.count, "drop");
+      return depth - self.count;
+    }
+
+    std::size_t operator()(const def& , std::size_t depth) const {
+      need(depth, 1, "def");
+      return depth;
+    }
+
+    std::size_t operator()(const sel& , std::size_t depth) const {
+      need(depth, 1, "selection");
+      return depth;
+    }
+
+    std::size_t operator()(const inj& , std::size_t depth) const {
+      need(depth, 1, "injection");
+      return depth;
+    }
+
+    std::size_t operator()(const record& self, std::size_t depth) const {
+      need(depth, self.attrs.size(), "record");
+      return depth - self.attrs.size() + 1;
+    }
+
+    // value produced by `self` from `depth`
+    void value(const expr& self, std::size_t depth, const char* what) const {
+      if(self.visit(*this, depth) != depth + 1) {
+        fail(std::string("unbalanced ") + what);
+      }
+    }
+    
+    std::size_t operator()(const ref<use>& self, std::size_t depth) const {
+      value(self->env, depth, "use");
+      return depth + 1;
+    }
+    
+    std::size_t operator()(const ref<branch>& self, std::size_t depth) const {
+      // note: test is popped
+      need(depth, 1, "branch");
+      value(self->then, depth - 1, "branch");
+      value(self->alt, depth - 1, "branch");
+      return depth;
+    }
+
+    std::size_t operator()(const ref<match>& self, std::size_t depth) const {
+      // note: matched value slot holds sum data, popped under the result
+      need(depth, 1, "match");
+      for(const auto& it: self->cases) {
+        value(it.second, depth, "match case");
+      }
+      value(self->fallback, depth, "match fallback");
+      return depth;
+    }
+
+    std::size_t operator()(const ref<closure>& self, std::size_t depth) const {
+      // note: closure is pushed before its captures
+      for(std::size_t i = 0, n = self->captures.size(); i < n; ++i) {
+        value(self->captures[i], depth + 1 + i, "capture");
+      }
+      
+      const verifier sub = {self->captures.size()};
+      sub.value(self->body, self->argc, "closure body");
+      return depth + 1;
+    }
+  };
+
+  
+  void verify(const expr& self) {
+    const verifier visitor = {0};
+    visitor.value(self, 0, "toplevel");
+  }
+
+
+  using clock = std::chrono::steady_clock;
+  
+  static expr optimize(const expr& self, const context& ctx,
+                       std::vector<pass>::const_iterator it) {
+    if(it == passes().end()) return self;
+    if(it->level > ctx.opts.level) return optimize(self, ctx, it + 1);
+
+    const clock::time_point start = clock::now();
+    const expr res = it->run(self, ctx);
+    
+    if(ctx.opts.times) {
+      (*ctx.opts.times)[it->name] +=
+        std::chrono::duration<double>(clock::now() - start).count();
+    }
+
+    if(ctx.opts.dump == it->name) {
+      std::clog << ";; ir after " << it->name << ":" << std::endl
+                << repr(res) << std::endl;
+    }
+
+    if(ctx.opts.verify) {
+      try {
+        verify(res);
+      } catch(std::runtime_error& e) {
+        throw std::runtime_error(e.what() + std::string(" after pass ") + it->name);
+      }
+    }
+    
+    return optimize(res, ctx, it + 1);
+  }
+  
+  
+  expr optimize(const expr& self, const context& ctx) {
+    if(ctx.opts.verify) verify(self);
+    return optimize(self, ctx, passes().begin());
+  }
+  
+}
@@ -1,12 +1,125 @@
 #ifndef SLIP_OPT_HPP
 #define SLIP_OPT_HPP
 
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "maybe.hpp"
+#include "ref.hpp"
+#include "symbol.hpp"
 
 namespace ir {
   struct expr;
+  struct closure;
+  
+  
+  // argument count of the closure held by a global, if known
+  using arity_type = std::function<maybe<std::size_t>(symbol)>;
+  
+  // rewrite saturated calls to globals of known arity into direct calls. note:
+  // closures defined by `self` are known in their own body, so that recursive
+  // calls are direct. must run before blocks are flattened
+  expr direct_calls(const expr& self, const arity_type& arity);
+
+
+  // mark closures without captures nested in closure bodies as lifted, so
+  // that they are allocated once per enclosing code instead of on every
+  // evaluation. note: globals are never captured, so closures only referring
+  // to globals are lifted as well
+  expr lambda_lift(const expr& self);
+
+
+  // inlining candidate: closure code, and how globals in its body are reached
+  // from call sites
+  struct callee {
+    ref<const closure> code;
+    
+    enum globals_type {
+      shared,                   // same globals
+      package,                  // attributes of the callee package record
+      foreign                   // unreachable
+    } globals = foreign;
+
+    // called once the body is inlined, so that the callee is no longer
+    // redefined
+    std::function<void()> pin;
+  };
+  
+  // candidate for calls to global `name`, or to attribute `attr` of the
+  // package record held by global `name`
+  using callee_type = std::function<callee(symbol name, maybe<symbol> attr)>;
+
+  // default inlining threshold, in ir nodes
+  static constexpr std::size_t inline_threshold = 24;
   
-  expr opt(const expr& self);
+  // substitute bodies of capture-free closures at saturated call sites, when
+  // no larger than `threshold` times the estimated frequency of the call
+  // site (none for toplevel code, which runs once). inlined bodies are
+  // processed in turn, except for calls back into the callees being inlined
+  expr inline_calls(const expr& self, const callee_type& callee,
+                    std::size_t threshold = inline_threshold);
+
+
+  // escape analysis: records only selected from (directly or through closure
+  // captures) until their slot is popped are replaced by their attribute
+  // values, kept in consecutive slots. note: targets dictionaries built at
+  // call sites of inlined functions, so must run after inlining and before
+  // blocks are flattened
+  expr scalar_replace(const expr& self);
+
 
+
+  // pipeline options
+  struct options {
+    // optimization level: passes run when their level is at most this one
+    std::size_t level = 2;
+    
+    std::size_t inline_threshold = ir::inline_threshold;
+
+    // check ir after each pass
+#ifdef NDEBUG
+    bool verify = false;
+#else
+    bool verify = true;
+#endif
+    
+    // dump ir to std::clog after this pass, if any
+    std::string dump;
+
+    // accumulate pass timings (in seconds) by name, if any
+    std::map<std::string, double>* times = nullptr;
+  };
+
+  
+  // pass inputs beyond the expression itself
+  struct context {
+    const options& opts;
+    const arity_type& arity;
+    const callee_type& callee;
+  };
+
+  
+  struct pass {
+    const char* name;
+    
+    // minimum optimization level
+    std::size_t level;
+    
+    std::function<expr(const expr& self, const context& ctx)> run;
+  };
+
+  // registered passes, in pipeline order
+  const std::vector<pass>& passes();
+
+  
+  // check stack discipline and variable indices, throwing on failure
+  void verify(const expr& self);
+  
+  // run passes enabled by `ctx.opts` on toplevel expression `self`
+  expr optimize(const expr& self, const context& ctx);
+  
 }
 
 
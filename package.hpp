@@ -4,6 +4,7 @@
 #include "symbol.hpp"
 
 #include <map>
+#include <mutex>
 #include <vector>
 #include <functional>
 
@@ -16,13 +17,37 @@ namespace package {
   std::string resolve(symbol name);
   std::vector<std::string>& path();
 
+  // loaded packages by value type. note: shared between threads
+  template<class Value>
+  struct cache {
+    std::recursive_mutex mutex;
+    std::map<symbol, Value> table;
+
+    static cache& instance() {
+      static cache res;
+      return res;
+    }
+  };
+  
   template<class Value>
   const Value& import(symbol name, std::function<Value()> cont) {
-    static std::map<symbol, Value> cache;
-    auto it = cache.find(name);
-    if(it != cache.end()) return it->second;
+    cache<Value>& self = cache<Value>::instance();
+    const std::lock_guard<std::recursive_mutex> lock(self.mutex);
     
-    return cache.emplace(name, cont()).first->second;
+    auto it = self.table.find(name);
+    if(it != self.table.end()) return it->second;
+    
+    return self.table.emplace(name, cont()).first->second;
+  }
+
+  // loaded package, if any
+  template<class Value>
+  const Value* find(symbol name) {
+    cache<Value>& self = cache<Value>::instance();
+    const std::lock_guard<std::recursive_mutex> lock(self.mutex);
+
+    auto it = self.table.find(name);
+    return it == self.table.end() ? nullptr : &it->second;
   }
 
   
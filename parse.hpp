@@ -548,11 +548,11 @@ struct debug {
     }
 
     static std::ostream* stream;
-    static std::size_t depth;
+    static thread_local std::size_t depth;
 };
 
 std::ostream* debug::stream = nullptr;
-std::size_t debug::depth = 0;
+thread_local std::size_t debug::depth = 0;
 }
 
 
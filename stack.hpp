@@ -4,6 +4,7 @@
 #include <vector>
 #include <cassert>
 #include <type_traits>
+#include <stdexcept>
 
 template<class T, std::size_t align=alignof(T)>
 class stack {
@@ -23,10 +24,12 @@ public:
   stack(std::size_t size) : storage(size), sp(0) { }
 
   T* allocate(std::size_t n) {
+    if(sp + n > storage.size()) {
+      throw std::runtime_error("stack overflow");
+    }
+    
     T* res = next();
     sp += n;
-    assert(sp <= storage.size() && "stack overflow");
-
     return res;
   }
 
@@ -0,0 +1,189 @@
+#include "stats.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+namespace stats {
+
+  count total(const census& self) {
+    count res;
+    for(const auto& it: self) {
+      res += it.second;
+    }
+    return res;
+  }
+
+
+  double collection::survivors() const {
+    return before.bytes ? double(after.bytes) / double(before.bytes) : 1;
+  }
+
+  static const char* name(collection::kind_type kind) {
+    return kind == collection::minor ? "minor" : "major";
+  }
+
+  static double micro(double seconds) { return seconds * 1e6; }
+
+  std::ostream& operator<<(std::ostream& out, const collection& self) {
+    out << name(self.kind) << ": pause " << micro(self.pause()) << "us"
+        << " (mark " << micro(self.mark) << "us, sweep " << micro(self.sweep) << "us)"
+        << ", objects " << self.before.objects << " -> " << self.after.objects
+        << ", bytes " << self.before.bytes << " -> " << self.after.bytes
+        << ", survivors " << 100 * self.survivors() << "%";
+
+    for(const auto& it: self.types) {
+      out << ", " << it.first << " " << it.second.objects;
+    }
+
+    return out;
+  }
+
+
+  void heap::add(collection self) {
+    if(log) *log << "gc " << name << " " << self << std::endl;
+    collections.emplace_back(std::move(self));
+  }
+
+
+  // pause histogram: power of two buckets, in microseconds
+  static std::vector<std::size_t> histogram(const heap& self) {
+    std::vector<std::size_t> res;
+    for(const collection& c: self.collections) {
+      std::size_t bucket = 0;
+      for(double us = micro(c.pause()); us >= 2; us /= 2) {
+        ++bucket;
+      }
+
+      if(bucket >= res.size()) res.resize(bucket + 1);
+      ++res[bucket];
+    }
+    return res;
+  }
+
+
+  // totals for a collection kind
+  struct totals {
+    std::size_t collections = 0;
+    double mark = 0, sweep = 0, max = 0;
+    count before, after;
+
+    totals(const heap& self, collection::kind_type kind) {
+      for(const collection& c: self.collections) {
+        if(c.kind != kind) continue;
+
+        ++collections;
+        mark += c.mark;
+        sweep += c.sweep;
+        max = std::max(max, c.pause());
+        before += c.before;
+        after += c.after;
+      }
+    }
+
+    double survivors() const {
+      return before.bytes ? double(after.bytes) / double(before.bytes) : 1;
+    }
+  };
+
+
+  void summary(std::ostream& out, const heap& self) {
+    out << "gc " << self.name << " summary:" << std::endl;
+
+    for(auto kind: {collection::minor, collection::major}) {
+      const totals t(self, kind);
+      out << "  " << name(kind) << ": " << t.collections << " collections"
+          << ", mark " << micro(t.mark) << "us, sweep " << micro(t.sweep) << "us"
+          << ", max pause " << micro(t.max) << "us"
+          << ", survivors " << 100 * t.survivors() << "%" << std::endl;
+    }
+
+    const std::vector<std::size_t> pauses = histogram(self);
+    if(!pauses.empty()) out << "  pauses:" << std::endl;
+    for(std::size_t i = 0, n = pauses.size(); i < n; ++i) {
+      if(!pauses[i]) continue;
+      out << "    < " << std::setw(8) << (2ul << i) << "us: " << pauses[i] << std::endl;
+    }
+
+    const count live = total(self.live);
+    out << "  live: " << live.objects << " objects, " << live.bytes << " bytes" << std::endl;
+    for(const auto& it: self.live) {
+      out << "    " << it.first << ": " << it.second.objects << " objects, "
+          << it.second.bytes << " bytes" << std::endl;
+    }
+  }
+
+
+  static std::ostream& json(std::ostream& out, const count& self) {
+    return out << "{\"objects\": " << self.objects
+               << ", \"bytes\": " << self.bytes << "}";
+  }
+
+  // note: type names are c++ identifiers, no escaping needed
+  static std::ostream& json(std::ostream& out, const census& self) {
+    out << "{";
+    bool first = true;
+    for(const auto& it: self) {
+      if(!first) out << ", ";
+      first = false;
+      json(out << "\"" << it.first << "\": ", it.second);
+    }
+    return out << "}";
+  }
+
+  static std::ostream& json(std::ostream& out, const collection& self) {
+    out << "{\"kind\": \"" << name(self.kind) << "\""
+        << ", \"mark\": " << self.mark
+        << ", \"sweep\": " << self.sweep
+        << ", \"pause\": " << self.pause();
+    json(out << ", \"before\": ", self.before);
+    json(out << ", \"after\": ", self.after);
+    out << ", \"survivors\": " << self.survivors();
+    if(self.kind == collection::major) {
+      json(out << ", \"types\": ", self.types);
+    }
+    return out << "}";
+  }
+
+  static std::ostream& json(std::ostream& out, const heap& self) {
+    out << "{\"name\": \"" << self.name << "\", \"collections\": [";
+    for(std::size_t i = 0, n = self.collections.size(); i < n; ++i) {
+      json(out << (i ? ", " : ""), self.collections[i]);
+    }
+    out << "]";
+
+    out << ", \"totals\": {";
+    for(auto kind: {collection::minor, collection::major}) {
+      const totals t(self, kind);
+      out << (kind == collection::minor ? "" : ", ")
+          << "\"" << name(kind) << "\": {\"collections\": " << t.collections
+          << ", \"mark\": " << t.mark
+          << ", \"sweep\": " << t.sweep
+          << ", \"max_pause\": " << t.max;
+      json(out << ", \"before\": ", t.before);
+      json(out << ", \"after\": ", t.after);
+      out << ", \"survivors\": " << t.survivors() << "}";
+    }
+    out << "}";
+
+    // note: bucket i counts pauses below 2^(i + 1) microseconds
+    out << ", \"pauses\": [";
+    const std::vector<std::size_t> pauses = histogram(self);
+    for(std::size_t i = 0, n = pauses.size(); i < n; ++i) {
+      out << (i ? ", " : "") << pauses[i];
+    }
+    out << "]";
+
+    json(out << ", \"live\": ", self.live);
+    return out << "}";
+  }
+
+  void json(std::ostream& out, const std::vector<const heap*>& heaps) {
+    out << "{\"heaps\": [";
+    for(std::size_t i = 0, n = heaps.size(); i < n; ++i) {
+      json(out << (i ? ", " : ""), *heaps[i]);
+    }
+    out << "]}" << std::endl;
+  }
+
+}
@@ -0,0 +1,76 @@
+#ifndef SLIP_STATS_HPP
+#define SLIP_STATS_HPP
+
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+// garbage collector telemetry
+namespace stats {
+
+  struct count {
+    std::size_t objects = 0;
+    std::size_t bytes = 0;
+
+    count& operator+=(const count& other) {
+      objects += other.objects;
+      bytes += other.bytes;
+      return *this;
+    }
+  };
+
+  // counts by object type
+  using census = std::map<std::string, count>;
+
+  count total(const census& self);
+
+
+  struct collection {
+    enum kind_type { minor, major } kind;
+
+    // durations in seconds. note: minor collections mark by copying
+    // survivors, and never sweep
+    double mark = 0;
+    double sweep = 0;
+
+    // objects in the collected generation, before and after collection
+    count before, after;
+
+    // major collections: surviving objects by type
+    census types;
+
+    double pause() const { return mark + sweep; }
+
+    // fraction of bytes surviving collection
+    double survivors() const;
+  };
+
+  std::ostream& operator<<(std::ostream& out, const collection& self);
+
+
+  // collections of a single heap
+  struct heap {
+    const std::string name;
+    std::vector<collection> collections;
+
+    // objects still allocated at exit
+    census live;
+
+    // per-collection report, if any
+    std::ostream* log = nullptr;
+
+    heap(std::string name): name(std::move(name)) { }
+
+    void add(collection self);
+  };
+
+  // totals by collection kind, pause histogram and live objects
+  void summary(std::ostream& out, const heap& self);
+
+  // machine-readable dump of all counters
+  void json(std::ostream& out, const std::vector<const heap*>& heaps);
+
+}
+
+#endif
@@ -11,7 +11,7 @@ namespace type {
     using key_type = ref<variable>;
     using value_type = mono;
     
-    using map_type = std::map<key_type, value_type>;
+    using map_type = hash_map<key_type, value_type>;
     map_type map;
   public:
 
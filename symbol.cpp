@@ -1,16 +1,138 @@
 #include "symbol.hpp"
 
-#include <set>
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+  // symbol table shard: open addressing over name hashes, with names
+  // allocated in chunks that are never freed so that symbols stay valid
+  class shard {
+    struct slot {
+      std::size_t hash;
+      std::size_t size;
+      const char* name = nullptr;
+    };
+
+    std::vector<slot> slots;
+    std::size_t count = 0;
+
+    static constexpr std::size_t chunk = 1ul << 12;
+    std::vector<std::unique_ptr<char[]>> chunks;
+    char* current = nullptr;
+    std::size_t used = 0;
+
+    char* allocate(std::size_t bytes) {
+      // note: keep headers aligned
+      bytes = (bytes + alignof(std::uint32_t) - 1) & ~(alignof(std::uint32_t) - 1);
+      if(bytes > chunk / 4) {
+        chunks.emplace_back(new char[bytes]);
+        return chunks.back().get();
+      }
+
+      if(!current || used + bytes > chunk) {
+        chunks.emplace_back(new char[chunk]);
+        current = chunks.back().get();
+        used = 0;
+      }
+
+      char* res = current + used;
+      used += bytes;
+      return res;
+    }
+
+    void grow() {
+      std::vector<slot> old(std::max<std::size_t>(64, 2 * slots.size()));
+      old.swap(slots);
+
+      const std::size_t mask = slots.size() - 1;
+      for(const slot& it: old) {
+        if(!it.name) continue;
+
+        std::size_t i = it.hash & mask;
+        while(slots[i].name) i = (i + 1) & mask;
+        slots[i] = it;
+      }
+    }
+
+  public:
+    std::mutex mutex;
+
+    // find interned name, or add the one returned by `make(allocate)`
+    template<class Make>
+    const char* find(std::size_t hash, const char* name, std::size_t size, Make make) {
+      if(2 * (count + 1) > slots.size()) grow();
+      const std::size_t mask = slots.size() - 1;
+
+      std::size_t i = hash & mask;
+      for(; slots[i].name; i = (i + 1) & mask) {
+        const slot& it = slots[i];
+        if(it.hash == hash && it.size == size && !std::memcmp(it.name, name, size)) {
+          return it.name;
+        }
+      }
+
+      ++count;
+      slots[i] = {hash, size, make([&](std::size_t bytes) { return allocate(bytes); })};
+      return slots[i].name;
+    }
+  };
+
+
+  struct table {
+    static constexpr std::size_t shards = 16;
+    shard self[shards];
+    std::atomic<std::uint32_t> next{0};
+
+    static table& instance() {
+      static table res;
+      return res;
+    }
+  };
+
+
+  // fnv-1a
+  static std::size_t hash(const char* name, std::size_t size) {
+    std::uint64_t res = 0xcbf29ce484222325ul;
+    for(std::size_t i = 0; i < size; ++i) {
+      res = (res ^ std::uint8_t(name[i])) * 0x100000001b3ul;
+    }
+    return res;
+  }
 
-symbol::symbol(const std::string& name) {
-  static std::set<std::string> table;
-  if(name.empty()) throw std::logic_error("empty symbol");
-  
-  this->name = table.insert(name).first->c_str();
 }
 
+
+const char* symbol::intern(const char* name, std::size_t size) {
+  if(!size) throw std::logic_error("empty symbol");
+
+  table& t = table::instance();
+
+  // note: shard on high bits, probe on low bits
+  const std::size_t h = hash(name, size);
+  shard& s = t.self[(h >> 56) % table::shards];
+
+  const std::lock_guard<std::mutex> lock(s.mutex);
+  return s.find(h, name, size, [&](const auto& allocate) {
+      char* res = allocate(sizeof(header) + size + 1) + sizeof(header);
+      reinterpret_cast<header*>(res)[-1] = {t.next++, std::uint32_t(size)};
+      std::memcpy(res, name, size);
+      res[size] = 0;
+      return res;
+    });
+}
+
+
+std::size_t symbol::count() {
+  return table::instance().next.load();
+}
+
+
 std::ostream& operator<<(std::ostream& out, const symbol& self) {
   return out << self.name;
 }
-
@@ -1,24 +1,58 @@
 #ifndef SLAP_SYMBOL_HPP
 #define SLAP_SYMBOL_HPP
 
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <string>
 
 
+// interned strings: symbols with equal names share the same storage and
+// dense id, assigned in creation order
 class symbol {
   const char* name;
+
+  // note: interned names are preceded by their id and size
+  struct header {
+    std::uint32_t id;
+    std::uint32_t size;
+  };
+
+  static const char* intern(const char* name, std::size_t size);
 public:
-  
-  explicit symbol(const std::string& name);
-  symbol(const char* name) : symbol(std::string(name)) { }
+
+  explicit symbol(const std::string& name): name(intern(name.data(), name.size())) { }
+  symbol(const char* name): name(intern(name, std::strlen(name))) { }
 
   inline const char* get() const { return name; }
-  inline bool operator<(const symbol& other) const { return name < other.name; }
+
+  inline std::uint32_t id() const {
+    return reinterpret_cast<const header*>(name)[-1].id;
+  }
+
+  inline std::size_t size() const {
+    return reinterpret_cast<const header*>(name)[-1].size;
+  }
+
+  // number of symbols interned so far, bounding ids
+  static std::size_t count();
+
+  // note: ordered by id, so that ordering does not depend on allocation
+  inline bool operator<(const symbol& other) const { return id() < other.id(); }
   inline bool operator==(const symbol& other) const { return name == other.name; }
   inline bool operator!=(const symbol& other) const { return name != other.name; }
 
   friend std::ostream& operator<<(std::ostream& out, const symbol& self);
-  
+
 };
 
 
+namespace std {
+  template<>
+  struct hash<symbol> {
+    std::size_t operator()(const symbol& self) const { return self.id(); }
+  };
+}
+
+
 #endif
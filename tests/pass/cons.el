@@ -0,0 +1,18 @@
+(import builtins)
+(import list)
+
+(def (range start end)
+     (if (builtins.= start end) list.nil
+       (list.cons start (range (builtins.+ start 1) end))))
+
+(def (concat lhs rhs)
+     (match lhs
+            (cons self (list.cons self.head (concat self.tail rhs)))
+            (nil _ rhs)))
+
+(def data (concat (range 0 10) (range 0 3)))
+data
+
+(list.foldl builtins.+ 0 data)
+(list.reverse data)
+(list.map (fn (x) (builtins.* 2 x)) data)
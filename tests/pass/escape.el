@@ -0,0 +1,67 @@
+(import builtins)
+(using builtins)
+
+;; records only selected from are kept in locals
+(def (norm x y)
+  (let ((p (record (x x) (y y))))
+    (+ (* p.x p.x) (* p.y p.y))))
+(norm 3 4)
+
+;; also when captured
+(def (adder n)
+  (let ((p (record (n n) (m 1))))
+    (fn (x) (+ x (+ p.n p.m)))))
+((adder 2) 3)
+
+;; escaping records are allocated
+(def (pair x)
+  (let ((p (record (first x) (second x))))
+    (let ((q p)) q)))
+(pair 5)
+
+;; shadowing keeps the record
+(def (shadow x)
+  (let ((p (record (x x))))
+    (let ((p (record (x 0)))) p.x)))
+(shadow 7)
+
+;; selection from literal
+(.b (record (a 1) (b 2)))
+
+;; matching an injection
+(match (|some 3)
+  (some x (+ x 1))
+  (none _ 0))
+
+;; dictionaries passed to inlined functions are kept in locals, also when
+;; captured
+(struct (monad (ctor m))
+        (pure (fn (a) (a -> (m a))))
+        (>>= (fn (a b) ((m a) -> (a -> (m b)) -> (m b)))))
+
+(union (maybe a)
+       (none unit)
+       (some a))
+
+(def (just a) (new maybe (some a)))
+
+(def (maybe-bind (maybe a) f)
+     (match a
+            (none _ (new maybe (none ())))
+            (some a (f a))))
+
+(def (lift2 (monad m) f a b)
+     (m.>>= a (fn (x) (m.>>= b (fn (y) (m.pure (f x y)))))))
+
+(def (add-maybe a b)
+     (lift2 (new monad (pure just) (>>= maybe-bind)) + a b))
+
+(add-maybe (just 1) (just 2))
+(add-maybe (just 1) (new maybe (none ())))
+
+;; returned dictionaries are allocated
+(def (keep (monad m)) m)
+(def (kept x)
+     (let ((m (keep (new monad (pure just) (>>= maybe-bind)))))
+       (m.pure x)))
+(kept 4)
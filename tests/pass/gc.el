@@ -0,0 +1,24 @@
+(import builtins)
+(import list)
+
+(def (range start end acc)
+     (if (builtins.= start end) acc
+       (range (builtins.+ start 1) end (list.cons start acc))))
+
+;; long-lived list, promoted while short-lived garbage is collected
+(def data (range 0 100000 list.nil))
+
+(def (churn n acc)
+     (if (builtins.= n 0) acc
+       (churn (builtins.- n 1)
+              (record (count (builtins.+ acc.count 1))
+                      (last (|some (fn (x) (builtins.+ x n))))))))
+
+(def result (churn 200000 (record (count 0) (last (|none ())))))
+result.count
+
+(match result.last
+       (some f (f 1))
+       (none _ 0))
+
+(list.foldl builtins.+ 0 data)
@@ -0,0 +1,66 @@
+(import builtins)
+(import list)
+(import func)
+
+;; small functions are inlined in closure bodies, including across packages
+(def (clamp lo hi x)
+  (if (builtins.< x lo) lo (if (builtins.> x hi) hi x)))
+
+(def (opt-or x d)
+  (match x
+    (some v (let ((w (builtins.+ v 1))) (builtins.* w 2)))
+    (none _ d)))
+
+(def (adder n) (fn (x) (builtins.+ x n)))
+
+(def (twice f x) (f (f x)))
+
+(def (h a b)
+  (let ((p (clamp 0 10 a))
+        (q (opt-or (|some b) 0)))
+    (builtins.+ (clamp p 20 (clamp 0 b (builtins.* p q)))
+                ((adder p) (twice (adder q) (opt-or (|none ()) 3))))))
+
+(h 4 5)
+(h 12 1)
+(h 0 7)
+
+(def (walk l acc) (list.foldl (fn (a x) (builtins.+ a (clamp 0 5 x))) acc l))
+
+(walk (list.cons 3 (list.cons 9 (list.cons 2 list.nil))) 0)
+(list.foldl (fn (a b) (builtins.+ a (clamp 0 3 b))) 0 (list.cons 7 (list.cons 1 list.nil)))
+(def (rev l) (list.reverse l))
+(rev (list.cons 1 (list.cons 2 (list.cons 3 list.nil))))
+(def (m l) (list.map (fn (x) (twice (adder x) 1)) l))
+(m (list.cons 1 (list.cons 2 (list.cons 3 list.nil))))
+
+;; loops inline larger bodies, then calls left in inlined bodies
+(def (poly x)
+  (builtins.+ (builtins.* x (builtins.* x x))
+              (builtins.+ (builtins.* 3 (builtins.* x x)) (builtins.- x 7))))
+(def (step x) (poly (builtins.+ x 1)))
+(def (steps n acc)
+  (if (builtins.= n 0) acc (steps (builtins.- n 1) (builtins.+ acc (step n)))))
+(steps 10 0)
+
+;; tail call sites keep tail calls of inlined bodies, other sites drop them
+(def (call f x) (f x))
+(def (tail-site g y) (call g y))
+(def (inner-site g y) (builtins.+ 1 (call g y)))
+(tail-site (adder 2) 3)
+(inner-site (adder 2) 3)
+
+(def (countdown n) (if (builtins.= n 0) 0 (call countdown (builtins.- n 1))))
+(countdown 200)
+
+;; closures in inlined bodies capture callee arguments and locals
+(def (affine a b)
+  (let ((c (builtins.* a 2)))
+    (fn (x) (builtins.+ (builtins.* c x) b))))
+(def (apply-affine x) ((affine 3 4) x))
+(apply-affine 5)
+(list.map (affine 1 0) (list.cons 1 (list.cons 2 list.nil)))
+
+;; package callees reach other package globals through the package record
+(def (append3 a b c) (list.concat a (list.concat b c)))
+(append3 (list.cons 1 list.nil) (list.cons 2 list.nil) (list.cons 3 list.nil))
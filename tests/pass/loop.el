@@ -0,0 +1,7 @@
+(import builtins)
+(using builtins)
+
+(let ((loop (fn (n acc)
+				(if (= n 0) acc
+				  (loop (- n 1) (+ acc 1))))))
+  (loop 1000000 0))
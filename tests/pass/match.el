@@ -0,0 +1,26 @@
+(import builtins)
+(using builtins)
+
+(def (f x)
+     (match x
+            (a v (+ v 1))
+            (b v (* v 2))
+            (c v 0)))
+
+(f (|a 1))
+(f (|b 5))
+(f (|c 5))
+
+;; fallback
+(def (get-or x d)
+     (match x
+            (_ d)
+            (some v v)))
+
+(get-or (|some 3) 0)
+(get-or (|none ()) 0)
+
+;; matched data below temporaries
+(+ 10 (match (|a 5)
+             (a x (let ((y 1)) (+ x y)))
+             (b x x)))
@@ -0,0 +1,10 @@
+(import builtins)
+(import list)
+
+;; folding lambda is lifted out of the function body
+(def (sum l) (list.foldl (fn (acc x) (builtins.+ acc x)) 0 l))
+(sum (list.cons 1 (list.cons 2 (list.cons 3 list.nil))))
+(sum (list.cons 4 list.nil))
+
+;; package records only hold package globals
+list
@@ -0,0 +1,15 @@
+(import builtins)
+(using builtins)
+
+(def (attr-a r) r.a)
+
+;; same selection site, several record shapes
+(attr-a (record (a 1)))
+(attr-a (record (b 2) (a 3)))
+(attr-a (record (a 4) (c 5)))
+(attr-a (record (c 1) (d 2) (a 6)))
+(attr-a (record (e 1) (a 7)))
+
+(def env (record (x 10) (y 20)))
+(using env)
+(+ x y)
@@ -0,0 +1,31 @@
+(import builtins)
+(using builtins)
+
+(def point (record (x 1) (y 2)))
+
+;; local use binds attributes to slots
+(run (do (using point) (pure (+ x y))))
+
+;; local definitions, recursive or not
+(def (square-next n) (do (def m (+ n 1)) (pure (* m m))))
+(run (square-next 3))
+
+(def (sum n)
+  (do (def (go i acc) (if (= i 0) acc (go (- i 1) (+ acc i))))
+      (pure (go n 0))))
+(run (sum 100))
+
+;; local import
+(def (sub-from n) (do (import func) (pure (func.flip - n 10))))
+(run (sub-from 3))
+
+;; bindings
+(def (twice-next n) (do (bind z (pure (+ n 1))) (pure (* z 2))))
+(run (twice-next 4))
+
+;; use inside function bodies
+(def (norm2) (do (using point) (pure (+ (* x x) (* y y)))))
+(run (norm2))
+
+(def (shifted n) (do (using (record (x n) (y (+ n 1)))) (pure (- y x))))
+(run (shifted 5))
@@ -1,7 +1,18 @@
 #include "vm.hpp"
+#include "bytecode.hpp"
 
 #include "sexpr.hpp"
 #include "package.hpp"
+#include "mark.hpp"
+#include "tool.hpp"
+#include "infer.hpp"
+#include "opt.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <set>
 
 namespace vm {
 
@@ -28,32 +39,339 @@ namespace vm {
   }
 
   
+  struct heap {
+    gc::heap memory;
+
+    // live states, as roots
+    std::set<state*> states;
+
+    // old objects possibly holding young references
+    std::vector<value> remembered;
+
+    // note: destroyed first, as package states unregister themselves
+    std::map<symbol, ref<state>> packages;
+
+    // live heap size above which marking is parallel
+    static constexpr std::size_t parallel_mark = 1ul << 23;
+
+    // collection statistics, if any
+    stats::heap* stats = nullptr;
+
+    // optimization options for package code
+    ir::options opts;
+    
+    heap(): memory(1ul << 18) { }
+  };
+
+  
   state::state(std::size_t size):
-    stack(size) {
+    state(new struct heap, size) {
+    owned.reset(heap);
+  }
+
+  state::state(struct heap* heap, std::size_t size):
+    stack(size),
+    heap(heap) {
     frames.reserve(size);    
-    frames.emplace_back(stack.next(), nullptr);
+    frames.emplace_back(stack.next());
+
+    heap->states.insert(this);
+  }
+
+  state::~state() {
+    heap->states.erase(this);
+  }
+  
+
+  std::size_t state::slot(symbol name) {
+    auto it = slots.emplace(name, globals.size());
+    if(it.second) {
+      globals.emplace_back(unit());
+      defined.emplace_back(false);
+      pinned.emplace_back(false);
+    }
+    
+    return it.first->second;
+  }
+
+
+  state& state::def(std::size_t slot, value global) {
+    if(defined[slot] && pinned[slot]) {
+      auto it = std::find_if(slots.begin(), slots.end(), [&](const auto& entry) {
+          return entry.second == slot;
+        });
+      throw std::runtime_error("redefinition of inlined global " +
+                               tool::quote(it->first.get()));
+    }
+    
+    globals[slot] = global;
+    defined[slot] = true;
+
+    auto it = sites.find(slot);
+    if(it == sites.end() || it->second.empty()) return *this;
+    
+    // keep direct calls matching the new value, patch others back
+    const std::size_t argc = global.is<gc::ref<closure>>() ?
+      global.cast<gc::ref<closure>>()->code->argc : std::size_t(-1);
+    
+    std::vector<site> keep;
+    for(const site& entry: it->second) {
+      const ref<const function> code = entry.code.lock();
+      if(!code) continue;
+      
+      word& w = code->code[entry.pc];
+      if(instr::arg(w) == argc) {
+        keep.emplace_back(entry);
+        continue;
+      }
+      
+      w = instr::make(instr::op(w) == opcode::direct ? opcode::call : opcode::tailcall,
+                      instr::arg(w));
+    }
+
+    it->second = std::move(keep);
+    return *this;
+  }
+
+
+  void state::link(const ref<const function>& code) {
+    for(const auto& it: code->directs) {
+      // note: drop sites of released code, e.g. toplevel expressions
+      std::vector<site>& entries = sites[it.second];
+      entries.erase(std::remove_if(entries.begin(), entries.end(), [](const site& entry) {
+            return entry.code.expired();
+          }), entries.end());
+      
+      entries.push_back({code, it.first});
+    }
+
+    if(!code->lifts.empty()) {
+      lifted.emplace_back(code);
+    }
+  }
+
+
+  maybe<std::size_t> state::arity(symbol name) const {
+    auto it = slots.find(name);
+    if(it == slots.end() || !defined[it->second]) return {};
+
+    const value& self = globals[it->second];
+    if(!self.is<gc::ref<closure>>()) return {};
+
+    return self.cast<gc::ref<closure>>()->code->argc;
+  }
+
+
+  // whether record holds exactly the globals of package state `owner`
+  static bool exported(const gc::ref<record>& self, const state* owner) {
+    const std::map<symbol, value> exports = owner->exports();
+    if(exports.size() != self->layout->size()) return false;
+
+    for(const auto& it: exports) {
+      const std::size_t index = self->layout->find(it.first);
+      if(index == self->layout->size() ||
+         !self->values()[index].same(it.second)) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+  
+  
+  ir::callee state::inlinable(symbol name, maybe<symbol> attr) {
+    auto it = slots.find(name);
+    if(it == slots.end() || !defined[it->second]) return {};
+
+    const std::size_t slot = it->second;
+    value self = globals[slot];
+    if(attr) {
+      if(!self.is<gc::ref<record>>()) return {};
+      const auto rec = self.cast<gc::ref<record>>();
+
+      const std::size_t index = rec->layout->find(attr.get());
+      if(index == rec->layout->size()) return {};
+      self = rec->values()[index];
+    }
+    
+    if(!self.is<gc::ref<closure>>()) return {};
+    const function& code = *self.cast<gc::ref<closure>>()->code;
+    if(!code.source) return {};
+
+    // note: the type checker rejects redefinitions of toplevel code, but
+    // other callers of def do not go through it: inlined code would go stale
+    if(!attr) {
+      return {code.source, code.owner == this ? ir::callee::shared : ir::callee::foreign,
+              [this, slot] { pinned[slot] = true; }};
+    }
+
+    const gc::ref<record> package = globals[slot].cast<gc::ref<record>>();
+    if(!exported(package, code.owner)) {
+      return {code.source, ir::callee::foreign, [this, slot] { pinned[slot] = true; }};
+    }
+
+    // note: the package global is also pinned in its own state
+    state* owner = code.owner;
+    const symbol member = attr.get();
+    return {code.source, ir::callee::package, [this, slot, owner, member] {
+        pinned[slot] = true;
+        owner->pinned[owner->slots.find(member)->second] = true;
+      }};
+  }
+
+
+  bool state::primitive(symbol name, maybe<symbol> attr) {
+    static const symbol package = "builtins";
+    const ref<state>* builtins = package::find<ref<state>>(package);
+    if(!builtins) return false;
+
+    const state& lib = **builtins;
+    auto expected = lib.slots.find(attr ? attr.get() : name);
+    if(expected == lib.slots.end() || !lib.defined[expected->second] ||
+       !lib.globals[expected->second].is<builtin>()) {
+      return false;
+    }
+    
+    auto it = slots.find(name);
+    if(it == slots.end() || !defined[it->second]) return false;
+
+    value self = globals[it->second];
+    if(attr) {
+      if(!self.is<gc::ref<record>>()) return false;
+      const auto rec = self.cast<gc::ref<record>>();
+
+      const std::size_t index = rec->layout->find(attr.get());
+      if(index == rec->layout->size()) return false;
+      self = rec->values()[index];
+    }
+
+    if(!self.is<builtin>() ||
+       !(self.cast<builtin>() == lib.globals[expected->second].cast<builtin>())) {
+      return false;
+    }
+
+    // note: records are immutable, pinning the global is enough
+    pinned[it->second] = true;
+    return true;
+  }
+
+  
+  std::map<symbol, value> state::exports() const {
+    std::map<symbol, value> res;
+    for(const auto& it: slots) {
+      if(defined[it.second]) {
+        res.emplace(it.first, globals[it.second]);
+      }
+    }
+    
+    return res;
+  }
+  
+  
+  // tag names by ordinal. note: shared between threads
+  static std::vector<symbol>& tags() {
+    static std::vector<symbol> res = {"nil", "cons"};
+    return res;
+  }
+
+  static std::mutex& tags_mutex() {
+    static std::mutex res;
+    return res;
   }
+  
+  std::size_t sum::ordinal(symbol tag) {
+    // note: indexed by symbol id
+    static std::vector<std::size_t> ordinals;
+    static constexpr std::size_t none = -1;
+
+    const std::lock_guard<std::mutex> lock(tags_mutex());
+    if(ordinals.empty()) {
+      for(std::size_t i = 0, n = tags().size(); i < n; ++i) {
+        const std::size_t id = tags()[i].id();
+        if(id >= ordinals.size()) ordinals.resize(id + 1, none);
+        ordinals[id] = i;
+      }
+    }
+    
+    if(tag.id() >= ordinals.size()) {
+      ordinals.resize(symbol::count(), none);
+    }
 
-  record::record(std::map<symbol, value> attrs):
-    attrs(attrs) {
-    // std::clog << __func__ << " " << this << std::endl;
+    std::size_t& res = ordinals[tag.id()];
+    if(res == none) {
+      res = tags().size();
+      tags().emplace_back(tag);
+    }
+    
+    return res;
   }
   
-  record::~record() {
-    // std::clog <<  __func__ << " " << this << std::endl;
+
+  symbol sum::name(std::size_t ordinal) {
+    const std::lock_guard<std::mutex> lock(tags_mutex());
+    return tags()[ordinal];
   }
   
   
-  static void run(state* s, const ir::expr& self);  
+  const shape* shape::intern(vector<symbol> attrs) {
+    std::sort(attrs.begin(), attrs.end());
 
+    // note: shapes are never released
+    static std::map<vector<symbol>, std::unique_ptr<const shape>> table;
+    static std::mutex mutex;
+
+    const std::lock_guard<std::mutex> lock(mutex);
+    
+    auto it = table.find(attrs);
+    if(it == table.end()) {
+      std::unique_ptr<const shape> res(new shape(attrs));
+      it = table.emplace(std::move(attrs), std::move(res)).first;
+    }
+    
+    return it->second.get();
+  }
+
+
+  std::size_t shape::find(symbol attr) const {
+    auto it = std::lower_bound(attrs.begin(), attrs.end(), attr);
+    if(it == attrs.end() || *it != attr) return size();
+    return it - attrs.begin();
+  }
+  
   
-  template<class T>
-  static value run(state* s, const T& ) {
-    throw std::runtime_error("run unimplemented for: "
-                             + tool::type_name(typeid(T)));
+  static gc::ref<record> make_record(const shape* layout) {
+    auto res = gc::make_ref_extra<record>(sizeof(value) * layout->size(), layout);
+    std::uninitialized_fill_n(res->values(), layout->size(), value(unit()));
+    return res;
+  }
+  
+  
+  // heap of the running state, for builtins updating heap values
+  static thread_local struct heap* running = nullptr;
+  
+  gc::ref<record> make_cell(const value& init) {
+    static const symbol attr = "value";
+    static const shape* const layout = shape::intern({attr});
+    
+    auto res = make_record(layout);
+    res->values()[0] = init;
+    return res;
   }
 
+  void update(const gc::ref<record>& cell, const value& value) {
+    cell->values()[0] = value;
+    if(gc::remember(cell)) running->remembered.emplace_back(cell);
+  }
   
+  
+  // captures are filled by a subsequent close instruction
+  static gc::ref<closure> make_closure(const ref<const function>& code) {
+    auto res = gc::make_ref_extra<closure>(sizeof(value) * code->captures, code);
+    std::uninitialized_fill_n(res->captures(), code->captures, value(unit()));
+    return res;
+  }
+  
+
   static constexpr bool debug = false;
 
 
@@ -93,322 +411,626 @@ namespace vm {
     return res;
   }
   
-  
-  template<class T>
-  static void run(state* s, const ir::lit<T>& self) {
-    push(s, self.value);
-  }
 
+  static void run(state* s, const function* code);
 
-  static void run(state* s, const ir::lit<string>& self) {
-    push(s, gc::make_ref<string>(self.value));
-  }
+  // collect if requested: only called between instructions, where all live
+  // values are reachable from states so that young objects may move
+  static void poll(state* s);
 
+  // write barrier for closures mutated after allocation
+  static void barrier(state* s, const gc::ref<closure>& self);
 
-  static void run(state* s, const ir::local& self) {
-    assert(s->frames.back().sp);
-    push(s, s->frames.back().sp[self.index]);
-  }
-  
-  
-  static void run(state* s, const ir::capture& self) {
-    assert(s->frames.back().cp);    
-    push(s, s->frames.back().cp[self.index]);
-  }
 
-  
-  static void run(state* s, const ir::global& self) {
-    auto it = s->globals.find(self.name);
-    assert(it != s->globals.end());
-    push(s, it->second);
+  // under-saturated call: replace function and arguments with a partial
+  // application
+  static void partial(state* s, const value* args, std::size_t argc) {
+    poll(s);
+    auto res = gc::make_ref_extra<pap>(argc * sizeof(value), args[-1], argc);
+    std::uninitialized_copy(args, args + argc, res->args());
+    
+    pop(s, argc);
+    *top(s) = res;
   }
 
-  
-  static void run(state* s, const ir::block& self) {
-    for(const ir::expr& e: self.items) {
-      run(s, e);
-    }
-  }
 
-  static void run(state* s, const ir::drop& self) {
-    pop(s, self.count);
-  }
+  // partial application call: splice stored arguments before call arguments,
+  // returns the new argument count
+  static std::size_t splice(state* s, value* args, std::size_t argc) {
+    const gc::ref<pap> self = args[-1].cast<gc::ref<pap>>();
 
-  
-  static void run(state* s, const ir::sel& self) {
-    auto rec = pop(s).cast<gc::ref<record>>();
-    auto it = rec->attrs.find(self.attr);
-    assert(it != rec->attrs.end() && "record attribute error");
-    push(s, it->second);
+    s->stack.allocate(self->argc);
+    std::move_backward(args, args + argc, args + argc + self->argc);
+    std::copy(self->args(), self->args() + self->argc, args);
+    args[-1] = self->func;
+    
+    return self->argc + argc;
   }
 
 
-  static void run(state* s, const ref<ir::match>& self) {
-    // precondition: matched value is pushed and is a sum value
-
-    const symbol tag = top(s)->cast<gc::ref<sum>>()->tag;
-    auto it = self->cases.find(tag);
-
-    if(it == self->cases.end()) {
-      run(s, self->fallback);
-    } else {
-      run(s, it->second);
-    }
+  // over-saturated closure call: move remaining arguments (and their count)
+  // below the function so that the apply stub can call the result with them
+  // on return, returns the new arguments pointer
+  static value* oversaturated(state* s, value* args, std::size_t argc,
+                              std::size_t expected) {
+    const std::size_t remaining = argc - expected;
+    
+    // [f a... r...] -> [f r... n f a...]
+    s->stack.allocate(2);
+    std::rotate(args, args + expected, args + argc);
+    std::move_backward(args + remaining, args + argc, args + argc + 2);
 
-    // TODO optimize?
+    args[remaining] = integer(remaining);
+    args[remaining + 1] = args[-1];
     
-    // pop match result
-    value result = pop(s);
+    return args + remaining + 2;
+  }
 
-    // pop matched value
-    pop(s, 1);
 
-    // push back result
-    push(s, std::move(result));
+  // return address for over-saturated closure calls
+  static const function& apply_stub() {
+    static const function instance = [] {
+      function res;
+      res.code.emplace_back(instr::make(opcode::apply));
+      return res;
+    }();
+    
+    return instance;
   }
   
   
-  static void run(state* s, const ir::exit& self) {
-    value result = pop(s);
-    pop(s, self.locals);
-    push(s, std::move(result));
-  }
-  
-
-  static void run(state* s, const ref<ir::branch>& self) {
-    // evaluate test
-    const bool test = pop(s).cast<boolean>();
-
-    if(test) {
-      run(s, self->then);
-    } else {
-      run(s, self->alt);
+  // note: package states are never moved, as compiled code refers to them
+  static const ref<state>& load(state* s, symbol package) {
+    // native packages are shared, other packages are loaded once per heap
+    if(const ref<state>* res = package::find<ref<state>>(package)) {
+      return *res;
     }
-  }
 
-  static value apply(state* s, const builtin& self,
-                     const value* args, std::size_t argc);
-  static value apply(state* s, const ref<closure>& self,
-                     const value* args, std::size_t argc);
-  static value apply(state* s, const value& self,
-                     const value* args, std::size_t argc);  
-  
+    auto it = s->heap->packages.find(package);
+    if(it != s->heap->packages.end()) return it->second;
+    
+    auto res = make_ref<state>(s->heap);
 
-  static value unsaturated(state* s, const value& self, std::size_t expected,
-                           const value* args, std::size_t argc) {
-    std::clog << "calling: " << self << " " << expected << " / " << argc << std::endl;
-    throw std::runtime_error("unimplemented: unsaturated");
+    // note: package code is type checked again to compile with inferred types
+    auto ts = make_ref<type::state>();
+    ts->types = make_ref<type::state::types_type>();
     
-    assert(argc != expected);
-    if(expected > argc) {
-      // under-saturated: close over available arguments + function
-      vector<value> captures(args, args + argc);
-      captures.emplace_back(self);
+    package::iter(package, [&](ast::expr self) {
+      type::infer(ts, self);
+      const ir::arity_type arity = [&](symbol name) {
+        return res->arity(name);
+      };
+
+      const ir::callee_type callee = [&](symbol name, maybe<symbol> attr) {
+        return res->inlinable(name, attr);
+      };
       
-      // closure call
-      vector<ir::expr> items; items.reserve(1 + argc + expected);
-
-      // push closure
-      items.emplace_back(ir::capture(argc));
+      const ir::builtin_type builtin = [&](symbol name, maybe<symbol> attr) {
+        return res->primitive(name, attr);
+      };
       
-      // push argc leading args from closure
-      for(std::size_t i = 0; i < argc; ++i) {
-        items.emplace_back(ir::capture(i));
-      }
+      const ir::expr e = ir::optimize(ir::compile(self, ts.get(), builtin),
+                                      {s->heap->opts, arity, callee});
+      const ref<const function> c = compile(res.get(), e);
+      ts->types->clear();
       
-      // push remaining args come from stack
-      for(std::size_t i = 0, n = expected - argc; i < n; ++i) {
-        items.emplace_back(ir::local(i));
-      }
-
-      // push saturated call
-      items.emplace_back(ir::call{argc + expected});
-      
-      return gc::make_ref<closure>(expected - argc, ir::block{std::move(items)}, std::move(captures));
-    } else {
-      // over-saturated: call expected arguments then call remaining args
-      // regularly
-      value tmp = apply(s, self, args, expected);
-      return tmp.match([&](const auto& self) {
-          return apply(s, self, args + expected, argc - expected);
-        });
-    }    
+      run(res.get(), c.get());
+      pop(res.get(), 1);
+    });
+    
+    return s->heap->packages.emplace(package, res).first->second;
   }
   
+  
+  static void import(state* s, symbol package) {
+    const ref<state>& pkg = load(s, package);
+    const std::map<symbol, value> exports = pkg->exports();
 
-
-  // builtin call
-  static value apply(state* s, const builtin& self,
-                     const value* args, std::size_t argc) {
-    if(self.argc() != argc) {
-      return unsaturated(s, self, self.argc(), args, argc);
+    vector<symbol> attrs;
+    for(const auto& it: exports) {
+      attrs.emplace_back(it.first);
     }
     
-    return self.func()(args);
+    auto res = make_record(shape::intern(std::move(attrs)));
+    for(const auto& it: exports) {
+      res->values()[res->layout->find(it.first)] = it.second;
+    }
+    
+    push(s, res);
   }
 
-  // closure call
-  static value apply(state* s, const gc::ref<closure>& self,
-                     const value* args, std::size_t argc) {
-    if(self->argc != argc) {
-      return unsaturated(s, self, self->argc, args, argc);      
-    }
 
-    // push frame
-    s->frames.emplace_back(args, self->captures.data());
+  // note: local uses are compiled to selections into locals, only toplevel
+  // uses define globals
+  static void use(state* s) {
+    assert(s->frames.size() == 1 && "use outside toplevel");
+
+    value env = pop(s);
     
-    // evaluate stuff
-    run(s, self->body);
+    auto rec = env.cast<gc::ref<record>>();
+    for(std::size_t i = 0, n = rec->layout->size(); i < n; ++i) {
+      s->def(rec->layout->attrs[i], rec->values()[i]);
+    }
 
-    // pop result
-    value result = pop(s);
+    push(s, unit());
+  }
+  
 
-    // sanity check
-    assert(s->stack.next() - s->frames.back().sp == argc);
-    
-    // pop frame
-    s->frames.pop_back();
-    return result;
+  static void select(state* s, const cache& self) {
+    const auto rec = top(s)->cast<gc::ref<record>>();
+    *top(s) = rec->values()[self.offset(rec->layout)];
   }
   
 
-  template<class T>
-  static value apply(state* s, const T& self, const value* args, std::size_t argc) {
-    throw std::runtime_error("type error in application: "
-                             + tool::type_name(typeid(T)));
+  static void make_record(state* s, const layout& self) {
+    poll(s);
+    auto res = make_record(self.self);
+
+    const std::size_t n = self.offsets.size();
+    const value* args = top(s) - (n - 1);
+    for(std::size_t i = 0; i < n; ++i) {
+      res->values()[self.offsets[i]] = args[i];
+    }
+
+    pop(s, n);
+    push(s, res);
   }
 
-  // main dispatch
-  static value call(state* s, const value* args, std::size_t argc) {
-    const value& self = args[-1];
-    
-    // switch(self.type()) {
-    // case value::index_of<builtin>::value:
-    //   return apply(s, self.cast<builtin>(), args, argc);
-    // case value::index_of<gc::ref<closure>>::value:
-    //   return apply(s, self.cast<gc::ref<closure>>(), args, argc);
-    // default: break;
-    // }
-    
-    // delegate call based on actual function type
-    return self.match([&](const auto& self) {
-        return apply(s, self, args, argc);
-      });
+
+  // arguments of a binary call to `expected` builtin, if callee is `expected`
+  static inline value* intrinsic(state* s, const value& expected) {
+    value* args = top(s) - 1;
+    const value& func = args[-1];
+
+    if(func.is<builtin>() && func.cast<builtin>() == expected.cast<builtin>()) {
+      return args;
+    }
+
+    return nullptr;
   }
 
+  
+  // threaded dispatch when labels as values are available
+#if defined(__GNUC__) && !defined(SLIP_SWITCH_DISPATCH)
+#define SLIP_THREADED_DISPATCH
+#endif
+  
+  // main loop: run code until halt, closure calls push frames on
+  // state::frames instead of recursing
+  static void run(state* s, const function* code) {
+    running = s->heap;
+    const word* pc = code->code.data();
+
+    // current frame
+    value* fp = s->frames.back().sp;
+    
+    word w;
 
-  static void run(state* s, const ir::call& self) {
-    // arguments pointer
-    const value* args = s->stack.next() - self.argc;
+    // call registers
+    std::size_t argc;
+    value* args;
     
-    // call function: call must cleanup the stack leaving exactly the function
-    // and its arguments in place
-    value result = call(s, args, self.argc);
+#ifdef SLIP_THREADED_DISPATCH
+    static const void* const labels[] = {
+#define SLIP_OPCODE_LABEL(name) &&op_##name,
+      SLIP_OPCODES(SLIP_OPCODE_LABEL)
+#undef SLIP_OPCODE_LABEL
+    };
     
-    // pop arguments
-    pop(s, self.argc);
+#define NEXT() w = *pc++; goto *labels[std::size_t(instr::op(w))]
+#define CASE(name) op_##name    
+    NEXT();
+#else
+#define NEXT() continue
+#define CASE(name) case opcode::name
+    for(;;) {
+      w = *pc++;
+      switch(instr::op(w)) {
+#endif
+        
+    CASE(unit): {
+      push(s, unit());
+      NEXT();
+    }
 
-    // push function result
-    *top(s) = std::move(result);
-  }
+    CASE(constant): {
+      push(s, code->constants[instr::arg(w)]);
+      NEXT();
+    }
 
+    CASE(string): {
+      poll(s);
+      push(s, gc::make_ref<string>(code->strings[instr::arg(w)]));
+      NEXT();
+    }
 
-  static void run(state* s, const ref<ir::closure>& self) {
-    // std::clog << "closure: " << repr(self) << std::endl;
+    CASE(local): {
+      assert(fp);
+      push(s, fp[instr::arg(w)]);
+      NEXT();
+    }
 
-    // result
-    auto res = gc::make_ref<closure>(self->argc, self->body);
+    CASE(capture): {
+      // note: closures may move during collections, hence no capture register
+      push(s, fp[-1].cast<gc::ref<closure>>()->captures()[instr::arg(w)]);
+      NEXT();
+    }
 
-    // note: pushing closure *before* filling captures so that it can be
-    // captured itself (recursive definitions)
-    push(s, res);
-    
-    const value* first = s->stack.next();
-    // push captured variables
-    for(const ir::expr& c : self->captures) {
-      run(s, c);
+    CASE(global): {
+      // note: globals are resolved in the state code was compiled against
+      assert(code->owner->defined[instr::arg(w)] && "undefined global");
+      push(s, code->owner->globals[instr::arg(w)]);
+      NEXT();
+    }
+
+    CASE(call): {
+      argc = instr::arg(w);
+      goto call;
+    }
+
+    CASE(direct): {
+      // note: callee is a closure taking exactly argc arguments, as
+      // redefinitions patch this instruction otherwise
+      argc = instr::arg(w);
+      args = s->stack.next() - argc;
+
+      const gc::ref<closure> self = args[-1].cast<gc::ref<closure>>();
+      s->frames.emplace_back(args, code, pc);
+      
+      code = self->code.get();
+      pc = code->code.data();
+      fp = args;
+      NEXT();
+    }
+
+    CASE(tail_direct): {
+      argc = instr::arg(w);
+      args = s->stack.next() - argc;
+
+      // move function and arguments over the current frame
+      frame& f = s->frames.back();
+      value* sp = f.sp;
+      std::move(args - 1, args + argc, sp - 1);
+      pop(s, s->stack.next() - (sp + argc));
+      
+      const gc::ref<closure> self = sp[-1].cast<gc::ref<closure>>();
+      
+      code = self->code.get();
+      pc = code->code.data();
+      fp = f.sp;
+      NEXT();
     }
     
-    // TODO move values from the stack into vector
-    std::vector<value> captures(first, first + self->captures.size());
+    CASE(tailcall): {
+      argc = instr::arg(w);
+      args = s->stack.next() - argc;
+
+      // move function and arguments over the current frame
+      frame& f = s->frames.back();
+      value* sp = f.sp;
+      std::move(args - 1, args + argc, sp - 1);
+      pop(s, s->stack.next() - (sp + argc));
+      args = sp;
+      
+      const value& func = args[-1];
+      if(func.is<gc::ref<closure>>() &&
+         func.cast<gc::ref<closure>>()->code->argc == argc) {
+        const gc::ref<closure> self = func.cast<gc::ref<closure>>();
+        
+        // reuse frame and jump to closure code
+        code = self->code.get();
+        pc = code->code.data();
+        fp = f.sp;
+        NEXT();
+      }
 
-    // pop captures
-    pop(s, self->captures.size());
+      // otherwise return to caller and call from there
+      code = f.code;
+      pc = f.pc;
+      
+      s->frames.pop_back();
+      fp = s->frames.back().sp;
+      goto call;
+    }
 
-    // set result captures
-    res->captures = std::move(captures);
-  }
+    call: {
+      // precondition: argc is set, function and arguments are pushed
+      args = s->stack.next() - argc;
+      const value& func = args[-1];
+
+      if(func.is<gc::ref<closure>>()) {
+        const gc::ref<closure> self = func.cast<gc::ref<closure>>();
+        const std::size_t expected = self->code->argc;
+
+        if(argc < expected) {
+          partial(s, args, argc);
+          NEXT();
+        }
+
+        if(argc > expected) {
+          args = oversaturated(s, args, argc, expected);
+
+          // return through apply stub
+          s->frames.emplace_back(fp, code, pc);
+          code = &apply_stub();
+          pc = code->code.data();
+        }
+        
+        // push frame and jump to closure code
+        s->frames.emplace_back(args, code, pc);
+        
+        code = self->code.get();
+        pc = code->code.data();
+        fp = args;
+        NEXT();
+      }
+      
+      if(func.is<builtin>()) {
+        const builtin self = func.cast<builtin>();
+        const std::size_t expected = self.argc();
+        
+        if(argc < expected) {
+          partial(s, args, argc);
+          NEXT();
+        }
+
+        // note: builtins may allocate
+        poll(s);
+        value result = self.func()(args);
+
+        // replace function with result and pop used arguments
+        args[-1] = result;
+        std::move(args + expected, args + argc, args);
+        pop(s, expected);
+
+        // over-saturated: call result with remaining arguments
+        if((argc -= expected)) goto call;
+        NEXT();
+      }
 
-  static void run(state* s, const ir::import& self) {
-    const state& pkg = package::import<state>(self.package, [&] {    
-      state s;
-      package::iter(self.package, [&](ast::expr self) {
-        const ir::expr c = ir::compile(self);
-        run(&s, c);
-      });
-      return s;
-    });
+      if(func.is<gc::ref<pap>>()) {
+        argc = splice(s, args, argc);
+        goto call;
+      }
 
-    push(s, gc::make_ref<record>(pkg.globals));
-  }
+      std::stringstream ss;
+      ss << "type error in application: " << func;
+      throw std::runtime_error(ss.str());
+    }
 
-  
-  static void run(state* s, const ir::def& self) {
-    assert(s->frames.size() == 1 && "toplevel definition in local scope");
+    CASE(apply): {
+      // return from over-saturated call: apply result to remaining arguments
+      value result = pop(s);
+      argc = pop(s).cast<integer>();
+      *(s->stack.next() - argc - 1) = std::move(result);
 
-    s->def(self.name, pop(s));
-    push(s, unit());
-  }
+      // back to caller
+      const frame& f = s->frames.back();
+      code = f.code;
+      pc = f.pc;
+      
+      s->frames.pop_back();
+      fp = s->frames.back().sp;
+      goto call;
+    }
+        
+#define SLIP_INTRINSIC(name, op)                                         \
+    CASE(name): {                                                       \
+      if(value* args = intrinsic(s, code->constants[instr::arg(w)])) {  \
+        const value res = args[0].cast<integer>() op args[1].cast<integer>(); \
+        args[-1] = res;                                                 \
+        pop(s, 2);                                                      \
+        NEXT();                                                         \
+      }                                                                 \
+                                                                        \
+      argc = 2;                                                         \
+      goto call;                                                        \
+    }
 
-  
-  static void run(state* s, const ref<ir::use>& self) {
-    assert(s->frames.size() == 1 && "non-toplevel use unimplemented");    
+    SLIP_INTRINSIC(add, +)
+    SLIP_INTRINSIC(sub, -)
+    SLIP_INTRINSIC(mul, *)
+    SLIP_INTRINSIC(eq, ==)
+    SLIP_INTRINSIC(lt, <)
+    SLIP_INTRINSIC(le, <=)
+    SLIP_INTRINSIC(gt, >)
+    SLIP_INTRINSIC(ge, >=)
+#undef SLIP_INTRINSIC
+
+#define SLIP_UNGUARDED(name, op)                                        \
+    CASE(name): {                                                       \
+      value* args = top(s) - 1;                                         \
+      const value res = args[0].cast<integer>() op args[1].cast<integer>(); \
+      args[0] = res;                                                    \
+      pop(s, 1);                                                        \
+      NEXT();                                                           \
+    }
 
-    // evalute use result
-    run(s, self->env);
+    SLIP_UNGUARDED(int_add, +)
+    SLIP_UNGUARDED(int_sub, -)
+    SLIP_UNGUARDED(int_mul, *)
+    SLIP_UNGUARDED(int_eq, ==)
+    SLIP_UNGUARDED(int_lt, <)
+    SLIP_UNGUARDED(int_le, <=)
+    SLIP_UNGUARDED(int_gt, >)
+    SLIP_UNGUARDED(int_ge, >=)
+#undef SLIP_UNGUARDED
+        
+    CASE(ret): {
+      value result = pop(s);
+
+      // pop arguments and replace function with result
+      const frame& f = s->frames.back();
+      pop(s, s->stack.next() - f.sp);
+      *top(s) = std::move(result);
+
+      // return to caller
+      code = f.code;
+      pc = f.pc;
+      
+      s->frames.pop_back();
+      fp = s->frames.back().sp;
+      NEXT();
+    }
+        
+    CASE(closure): {
+      poll(s);
+      push(s, make_closure(code->functions[instr::arg(w)]));
+      NEXT();
+    }
 
-    value env = pop(s);
+    CASE(lifted): {
+      const function::lift& self = code->lifts[instr::arg(w)];
+      if(self.instance.is<unit>()) {
+        poll(s);
+        self.instance = make_closure(self.code);
+      }
+      
+      push(s, self.instance);
+      NEXT();
+    }
     
-    // TODO compile local uses properly with type-system help
-    for(const auto& it: env.cast<gc::ref<record>>()->attrs) {
-      s->def(it.first, it.second);
+    CASE(close): {
+      // precondition: captures are pushed on top of closure
+      const std::size_t size = instr::arg(w);
+      const value* first = s->stack.next() - size;
+
+      const auto self = first[-1].cast<gc::ref<closure>>();
+      std::copy(first, first + size, self->captures());
+      barrier(s, self);
+      
+      pop(s, size);
+      NEXT();
+    }
+        
+    CASE(drop): {
+      pop(s, instr::arg(w));
+      NEXT();
     }
 
-    push(s, unit());
-  }
+    CASE(exit): {
+      // move result down
+      value* result = top(s);
+      *(result - instr::arg(w)) = *result;
+      pop(s, instr::arg(w));
+      NEXT();
+    }
 
+    CASE(jump): {
+      pc = code->code.data() + instr::arg(w);
+      NEXT();
+    }
 
-  static void run(state* s, const ir::record& self) {
-    record::attrs_type attrs;
-    
-    for(auto it = self.attrs.rbegin(), end = self.attrs.rend(); it != end; ++it) {
-      attrs.emplace(*it, pop(s));
+    CASE(jump_false): {
+      if(!pop(s).cast<boolean>()) {
+        pc = code->code.data() + instr::arg(w);
+      }
+      NEXT();
     }
 
-    push(s, gc::make_ref<record>(std::move(attrs)));
-  }
+    CASE(match): {
+      // precondition: matched value is pushed and is a sum value or a list
+      value* self = top(s);
+      std::size_t tag;
+      
+      if(self->is<gc::ref<sum>>()) {
+        const auto data = self->cast<gc::ref<sum>>();
+        tag = data->tag;
+        *self = data->data;
+      } else if(self->is<gc::ref<cons>>()) {
+        tag = sum::cons_tag;
+      } else {
+        assert(self->is<nil>());
+        tag = sum::nil_tag;
+        *self = unit();
+      }
+      
+      pc = code->code.data() + code->matches[instr::arg(w)].find(tag);
+      NEXT();
+    }
 
+    CASE(inj): {
+      poll(s);
+      *top(s) = gc::make_ref<sum>(instr::arg(w), *top(s));
+      NEXT();
+    }
 
-  // main dispatch
-  static void run(state* s, const ir::expr& self) {
-    self.match([&](const auto& self) {
-      run(s, self);
-    });
+    CASE(sel): {
+      select(s, code->selects[instr::arg(w)]);
+      NEXT();
+    }
+
+    CASE(head): {
+      value* self = top(s);
+      if(self->is<gc::ref<cons>>()) *self = self->cast<gc::ref<cons>>()->head;
+      else select(s, code->selects[instr::arg(w)]);
+      NEXT();
+    }
+
+    CASE(tail): {
+      value* self = top(s);
+      if(self->is<gc::ref<cons>>()) *self = self->cast<gc::ref<cons>>()->tail;
+      else select(s, code->selects[instr::arg(w)]);
+      NEXT();
+    }
+
+    CASE(record): {
+      make_record(s, code->records[instr::arg(w)]);
+      NEXT();
+    }
+
+    CASE(import): {
+      import(s, code->symbols[instr::arg(w)]);
+      NEXT();
+    }
+
+    CASE(use): {
+      use(s);
+      NEXT();
+    }
+
+    CASE(def): {
+      assert(s->frames.size() == 1 && "toplevel definition in local scope");
+      code->owner->def(instr::arg(w), pop(s));
+      push(s, unit());
+      NEXT();
+    }
+
+    CASE(halt): {
+      return;
+    }
+        
+#ifndef SLIP_THREADED_DISPATCH
+      }
+    }
+#endif
+    
+#undef NEXT
+#undef CASE
   }
 
   ////////////////////////////////////////////////////////////////////////////////
   
 
   value eval(state* s, const ir::expr& self) {
+    const gc::scope scope(s->heap->memory);
+    
     // std::clog << repr(self) << std::endl;
-    run(s, self);
-    value res = pop(s);
-
-    // hack: prevent last value from being collected
-    s->globals.emplace("__last__", res).first->second = res;
+    const ref<const function> code = compile(s, self);
+    // std::clog << *code << std::endl;
     
-    collect(s);
-    return res;
+    const std::size_t size = s->stack.size();
+    try {
+      run(s, code.get());
+    } catch(...) {
+      // unwind
+      s->frames.erase(s->frames.begin() + 1, s->frames.end());
+      pop(s, s->stack.size() - size);
+      throw;
+    }
+    
+    // note: no allocation may happen before result is used
+    return pop(s);
   }
 
 
@@ -416,57 +1038,288 @@ namespace vm {
     self.match([&](const auto& self) { out << self; },
                [&](const unit& self) { out << "()"; },
                [&](const gc::ref<closure>& ) { out << "#<closure>"; },
+               [&](const gc::ref<pap>& ) { out << "#<closure>"; },
                [&](const builtin& ) { out << "#<builtin>"; },
                [&](const boolean& self) { out << (self ? "true" : "false"); },
                [&](const gc::ref<string>& self) { out << '"' << *self << '"';},
                [&](const gc::ref<record>& self) {
                  out << "{";
-                 bool first=true;
-                 for(const auto& it: self->attrs) {
-                   if(first) first = false;
-                   else out << "; ";
-                   out << it.first << ": " << it.second;
+                 for(std::size_t i = 0, n = self->layout->size(); i < n; ++i) {
+                   if(i) out << "; ";
+                   out << self->layout->attrs[i] << ": " << self->values()[i];
                  }
                  out << "}";                 
                },
                [&](const gc::ref<sum>& self) {
-                 out << "<" << self->tag << ": " << self->data << ">";
+                 out << "<" << sum::name(self->tag) << ": " << self->data << ">";
+               },
+               [&](const nil& ) { out << "()"; },
+               [&](const gc::ref<cons>& self) {
+                 out << "(" << self->head;
+                 value it = self->tail;
+                 while(it.is<gc::ref<cons>>()) {
+                   const auto cell = it.cast<gc::ref<cons>>();
+                   out << " " << cell->head;
+                   it = cell->tail;
+                 }
+                 out << ")";
                });
     return out;
   }
 
   ////////////////////////////////////////////////////////////////////////////////
-  struct mark_visitor {
+  // visit mutable value slots of a heap value
+  template<class Func>
+  static void slots(const value& self, Func func) {
+    self.match([&](const auto& ) { },
+               [&](const gc::ref<record>& self) {
+                 for(std::size_t i = 0, n = self->layout->size(); i < n; ++i) {
+                   func(self->values()[i]);
+                 }
+               },
+               [&](const gc::ref<sum>& self) { func(self->data); },
+               [&](const gc::ref<cons>& self) {
+                 func(self->head);
+                 func(self->tail);
+               },
+               [&](const gc::ref<closure>& self) {
+                 for(std::size_t i = 0; i < self->code->captures; ++i) {
+                   func(self->captures()[i]);
+                 }
+               },
+               [&](const gc::ref<pap>& self) {
+                 func(self->func);
+                 for(std::size_t i = 0; i < self->argc; ++i) {
+                   func(self->args()[i]);
+                 }
+               });
+  }
+
+  
+  static void barrier(state* s, const gc::ref<closure>& self) {
+    if(gc::remember(self)) s->heap->remembered.emplace_back(self);
+  }
+
+
+  // visit lifted closures of code compiled against `s`, dropping released
+  // code
+  template<class Func>
+  static void lifts(state* s, Func func) {
+    auto it = std::remove_if(s->lifted.begin(), s->lifted.end(),
+                             [&](const std::weak_ptr<const function>& entry) {
+                               const ref<const function> code = entry.lock();
+                               if(!code) return true;
+                               
+                               for(const function::lift& l: code->lifts) {
+                                 func(l.instance);
+                               }
+                               return false;
+                             });
+    s->lifted.erase(it, s->lifted.end());
+  }
+
+  
+  // update slot to the promoted copy of a young object, queuing fresh copies
+  // for scanning
+  struct promote_visitor {
+    gc::heap& memory;
+    std::vector<value>& queue;
+    
     template<class T>
-    void operator()(T self, bool debug) const { }
+    void operator()(T, value&) const { }
 
     template<class T>
-    void operator()(gc::ref<T> self, bool debug) const {
-      if(debug) std::clog << "  marking: " << self.get() << std::endl;              
-      self.mark();
+    void operator()(gc::ref<T> self, value& slot) const {
+      if(!gc::young(self)) return;
+
+      const bool fresh = !gc::promoted(self);
+      slot = memory.promote(self);
+      if(fresh) queue.emplace_back(slot);
     }
+  };
 
-    void operator()(gc::ref<record> self, bool debug) const {
-      self.mark();
-      
-      for(auto& it : self->attrs) {
-        if(debug) std::clog << "  visiting: " << it.first << std::endl;        
-        it.second.visit(*this, debug);
+  
+  struct forget_visitor {
+    template<class T>
+    void operator()(T) const { }
+
+    template<class T>
+    void operator()(gc::ref<T> self) const { gc::forget(self); }
+  };
+  
+  
+  using clock = std::chrono::steady_clock;
+
+  static double seconds(clock::time_point start) {
+    return std::chrono::duration<double>(clock::now() - start).count();
+  }
+
+  static stats::count convert(const gc::count& self) {
+    stats::count res;
+    res.objects = self.objects;
+    res.bytes = self.bytes;
+    return res;
+  }
+
+  // census names of heap object types
+  static std::string name(const std::type_info& type) {
+    if(type == typeid(string)) return "string";
+    if(type == typeid(closure)) return "closure";
+    if(type == typeid(record)) return "record";
+    if(type == typeid(sum)) return "sum";
+    if(type == typeid(pap)) return "pap";
+    if(type == typeid(cons)) return "cons";
+    return tool::type_name(type);
+  }
+  
+  static stats::census census(const gc::heap& self, bool marked) {
+    stats::census res;
+    self.census([&](const std::type_info& type, const gc::count& c) {
+        res[name(type)] += convert(c);
+      }, marked);
+    return res;
+  }
+  
+  
+  // minor collection: copy young objects reachable from roots and remembered
+  // objects to the old generation, breadth-first so that work is
+  // proportional to survivors
+  static void minor(struct heap* self) {
+    const clock::time_point start = clock::now();
+    
+    std::vector<value> queue;
+    const promote_visitor visitor = {self->memory, queue};
+    
+    const auto promote = [&](value& slot) {
+      slot.visit(visitor, slot);
+    };
+    
+    for(state* s: self->states) {
+      for(value& global: s->globals) {
+        promote(global);
       }
+      lifts(s, promote);
+
+      const std::size_t size = s->stack.size();
+      value* first = s->stack.next() - size;
+      std::for_each(first, first + size, promote);
+    }
+
+    for(const value& obj: self->remembered) {
+      slots(obj, promote);
+      obj.visit(forget_visitor());
+    }
+    self->remembered.clear();
+
+    // note: queue grows while scanning
+    for(std::size_t i = 0; i < queue.size(); ++i) {
+      const value obj = queue[i];
+      slots(obj, promote);
+    }
+
+    if(self->stats) {
+      stats::collection c;
+      c.kind = stats::collection::minor;
+      c.mark = seconds(start);
+      c.before = convert(self->memory.allocated_young());
+      c.after = convert(self->memory.promoted_young());
+      self->stats->add(std::move(c));
     }
     
+    self->memory.flip();
+  }
+
+
+  // mark value, true when it is a heap object that was not marked yet
+  struct mark_visitor {
+    template<class T>
+    bool operator()(T) const { return false; }
+
+    template<class T>
+    bool operator()(gc::ref<T> self) const { return self.mark(); }
   };
+
   
-  static void mark(state* self, bool debug) {
-    for(auto& it : self->globals) {
-      if(debug) std::clog << "visiting: " << it.first << std::endl;
-      it.second.visit(mark_visitor(), debug);
+  // major collection: mark from roots, in parallel for large heaps, then sweep
+  // lazily. note: previous sweep must complete before marking
+  static void major(struct heap* self) {
+    clock::time_point start = clock::now();
+    self->memory.finish();
+
+    stats::collection c;
+    c.kind = stats::collection::major;
+    c.sweep = seconds(start);
+
+    if(self->stats) {
+      c.before = stats::total(census(self->memory, false));
+    }
+    
+    start = clock::now();
+    std::vector<value> roots;
+    const auto root = [&](const value& item) {
+      if(item.visit(mark_visitor())) roots.emplace_back(item);
+    };
+    
+    for(state* s: self->states) {
+      std::for_each(s->globals.begin(), s->globals.end(), root);
+      lifts(s, root);
+
+      // note: callee closures stay on the stack during calls
+      const std::size_t size = s->stack.size();
+      const value* first = s->stack.next() - size;
+      std::for_each(first, first + size, root);
+    }
+
+    const auto trace = [](const value& item, const auto& push) {
+      slots(item, [&](const value& child) {
+        if(child.visit(mark_visitor())) push(child);
+      });
+    };
+
+    mark::work<value>::run(std::move(roots), trace,
+                           self->memory.budget >= heap::parallel_mark);
+    c.mark = seconds(start);
+
+    if(self->stats) {
+      c.types = census(self->memory, true);
+      c.after = stats::total(c.types);
     }
+    
+    start = clock::now();
+    self->memory.sweep();
+    c.sweep += seconds(start);
+
+    if(self->stats) self->stats->add(std::move(c));
+  }
+
+
+  static void poll(state* s) {
+    if(!s->heap->memory.pending()) return;
+
+    minor(s->heap);
+    if(s->heap->memory.exhausted()) major(s->heap);
   }
 
+  
   void collect(state* self) {
-    mark(self, false);
-    gc::sweep();
+    minor(self->heap);
+    major(self->heap);
+  }
+
+
+  void monitor(state* self, stats::heap* stats) {
+    self->heap->stats = stats;
+  }
+
+
+  void pipeline(state* self, const ir::options& opts) {
+    self->heap->opts = opts;
+  }
+
+
+  stats::census census(state* self) {
+    self->heap->memory.finish();
+    return census(self->heap->memory, false);
   }
   
 }
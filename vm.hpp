@@ -1,10 +1,17 @@
 #ifndef SLIP_VM_HPP
 #define SLIP_VM_HPP
 
+#include <cstdint>
+#include <memory>
+
 #include "eval.hpp"
+#include "hash_map.hpp"
+#include "maybe.hpp"
 #include "stack.hpp"
+#include "stats.hpp"
 
 #include "ir.hpp"
+#include "opt.hpp"
 #include "nan.hpp"
 
 namespace vm {
@@ -14,6 +21,15 @@ namespace vm {
   
   struct value;
   struct closure;
+  struct pap;
+  struct cons;
+
+  // empty list
+  struct nil { };
+
+  // compiled code
+  struct function;
+  using word = std::uint32_t;
 
   class builtin {
     using func_type = value (*)(const value* args);
@@ -28,6 +44,10 @@ namespace vm {
     
     func_type func() const;
     std::size_t argc() const;    
+
+    bool operator==(const builtin& other) const {
+      return storage.bits == other.storage.bits;
+    }
     
     builtin(std::size_t argc, func_type func);
 
@@ -36,22 +56,50 @@ namespace vm {
   };
 
   
+  // record layout: sorted attribute names, interned so that records with the
+  // same attributes share the same shape
+  struct shape {
+    const vector<symbol> attrs;
+
+    static const shape* intern(vector<symbol> attrs);
+    
+    std::size_t size() const { return attrs.size(); }
+    
+    // attribute offset, size() when not found
+    std::size_t find(symbol attr) const;
+    
+  private:
+    shape(vector<symbol> attrs): attrs(std::move(attrs)) { }
+  };
+
+  
+  // record: shape + attribute values, stored inline
   struct record {
-    using attrs_type = std::map<symbol, value>;
-    attrs_type attrs;
+    const shape* const layout;
 
-    record(attrs_type attrs);
-    ~record();
+    record(const shape* layout): layout(layout) { }
+    
+    value* values() { return reinterpret_cast<value*>(this + 1); }
+    const value* values() const { return reinterpret_cast<const value*>(this + 1); }
   };
 
 
   struct sum;
 
+  struct value;
+  
+  // reference cell for io builtins: a one-attribute record, updated in place
+  // through the write barrier of the running heap
+  gc::ref<record> make_cell(const value& init);
+  void update(const gc::ref<record>& cell, const value& value);
+  
   struct value : nan::variant<unit, boolean, integer, gc::ref<string>, builtin,
                              // list<value>,
                              // gc::ref<value>,
                               gc::ref<closure>,
-                              gc::ref<record>, gc::ref<sum>> {
+                              gc::ref<record>, gc::ref<sum>,
+                              gc::ref<pap>,
+                              nil, gc::ref<cons>> {
     using value::variant::variant;
 
     friend std::ostream& operator<<(std::ostream& out, const value& self);
@@ -59,57 +107,169 @@ namespace vm {
 
 
                          
+  // closure: shared code + captured values, stored inline (code->captures
+  // of them)
   struct closure {
-    const std::size_t argc;
-    const ir::block body;
+    const ref<const function> code;
     
-    std::vector<value> captures;
-    
-    closure(std::size_t argc,
-            ir::block body,
-            std::vector<value> captures={}):
-      argc(argc),
-      body(std::move(body)),
-      captures(std::move(captures)){ }
+    closure(ref<const function> code):
+      code(std::move(code)) { }
+
+    value* captures() { return reinterpret_cast<value*>(this + 1); }
+    const value* captures() const { return reinterpret_cast<const value*>(this + 1); }
   };
 
   
+  // partial application: function and leading arguments, stored inline
+  struct pap {
+    value func;
+    const std::size_t argc;
+
+    pap(const value& func, std::size_t argc):
+      func(func),
+      argc(argc) { }
+
+    value* args() { return reinterpret_cast<value*>(this + 1); }
+    const value* args() const { return reinterpret_cast<const value*>(this + 1); }
+  };
+
+  
+  // sum value: tags are interned to dense ordinals so that matches can
+  // dispatch through jump tables
   struct sum {
-    symbol tag;
+    const std::size_t tag;
     value data;
+
+    sum(std::size_t tag, value data):
+      tag(tag),
+      data(data) { }
+    
+    static std::size_t ordinal(symbol tag);
+    static symbol name(std::size_t ordinal);
+
+    // reserved ordinals for list tags
+    static constexpr std::size_t nil_tag = 0;
+    static constexpr std::size_t cons_tag = 1;
   };
 
   
+  // list cell: matches as `cons` with itself as data, with `head`/`tail`
+  // attributes. note: heap values are only ever updated by the collector
+  struct cons {
+    value head;
+    value tail;
+
+    cons(const value& head, const value& tail):
+      head(head),
+      tail(tail) { }
+  };
+
+  
+  // note: the callee closure sits right below the frame start, so that
+  // captures are found through sp[-1] even after the closure moved
   struct frame {
-    const value* sp;            // frame start
-    const value* cp;            // capture pointer
+    value* sp;                  // frame start
+
+    const function* code;       // caller code
+    const word* pc;             // return address
     
-    frame(const value* sp,
-          const value* cp):
+    frame(value* sp,
+          const function* code=nullptr,
+          const word* pc=nullptr):
       sp(sp),
-      cp(cp) { }
+      code(code),
+      pc(pc) { }
   };
   
 
+  // interpreter heap: objects, roots and loaded packages, shared between a
+  // toplevel state and the package states it imports
+  struct heap;
+  
   struct state {
     class stack<value> stack;
     std::vector<frame> frames;
 
+    // note: states register themselves as roots of their heap
     state(const state&) = delete;
-    state(state&&) = default;
+    state(state&&) = delete;
     
-    std::map<symbol, value> globals;
+    // global variables are interned to dense slots when code is compiled, so
+    // that global access is a single indexed load
+    hash_map<symbol, std::size_t> slots;
+    std::vector<value> globals;
+    std::vector<bool> defined;
+
+    // slots whose value was inlined in compiled code
+    std::vector<bool> pinned;
 
+    // toplevel state, owning its heap
     state(std::size_t size=1000);
 
+    // package state
+    state(struct heap* heap, std::size_t size=1000);
+    
+    ~state();
+
+    struct heap* const heap;
+
+    // slot for global name, allocating an undefined slot if needed
+    std::size_t slot(symbol name);
+
+    // note: redefinitions update the slot in place, so that all compiled
+    // code referring to it sees the new value. direct calls to the slot are
+    // patched back to regular calls unless the new value is a closure of the
+    // same arity. defined slots pinned by inlining cannot be redefined
+    state& def(std::size_t slot, value global);
+    
     state& def(symbol name, value global) {
-      globals.emplace(name, global);
-      return *this;
+      return def(slot(name), global);
     }
 
+    // defined globals by name
+    std::map<symbol, value> exports() const;
+
+    // register direct call sites and lifted closures of compiled code
+    void link(const ref<const function>& code);
+
+    // argument count of the closure held by global `name`, if any
+    maybe<std::size_t> arity(symbol name) const;
+
+    // closure held by global `name` (or attribute `attr` of the package record
+    // it holds), for inlining. the callee pins the slots it was read from
+    ir::callee inlinable(symbol name, maybe<symbol> attr);
+
+    // whether global `name` (or attribute `attr` of the record it holds) is
+    // the integer builtin of the same name, pinning it if so
+    bool primitive(symbol name, maybe<symbol> attr);
+    
+    // direct call sites by callee slot
+    struct site {
+      std::weak_ptr<const function> code;
+      std::size_t pc;
+    };
+    
+    hash_map<std::size_t, std::vector<site>> sites;
+
+    // code holding lifted closures
+    std::vector<std::weak_ptr<const function>> lifted;
+    
+  private:
+    std::unique_ptr<struct heap> owned;
   };
 
+  // full collection of state heap
   void collect(state* self);
+
+  // report collections of state heap to `stats`, or stop reporting when null
+  void monitor(state* self, stats::heap* stats);
+
+  // live objects in state heap, by type
+  stats::census census(state* self);
+
+  // optimization options for code compiled in state heap, packages included
+  void pipeline(state* self, const ir::options& opts);
+
   value eval(state* self, const ir::expr& expr);
 
 